@@ -1,14 +1,35 @@
 #include "PapyrusIni.h"
 
+#if LEGENDARY_EDITION
+#include "skse/GameThreads.h"
+#include "skse/PapyrusEvents.h"
+#else
+#include "skse64/gamethreads.h"
+#include "skse64/PapyrusEvents.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
 #include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <stdexcept>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <iostream>
 #include <iomanip>
 #include <ctime>
 #include <sstream>
 #include <filesystem>
+#include <functional>
+#include <set>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
 
 #include <ShlObj.h>
 #include <WinBase.h>
@@ -19,10 +40,46 @@
 #define PAPYRUS_FUNCTION StaticFunctionTag* base
 
 constexpr auto BUFFER_SIZE = 32;
+constexpr auto MAX_ARRAY_SIZE = 128;
+// bufferSize of reads that return the whole value, however long it is
+constexpr auto FULL_VALUE = -1;
+// initial buffer of non-buffered reads of whole values, doubled until the value fits
+constexpr auto FULL_VALUE_BUFFER_SIZE = 1024;
+constexpr auto LIST_DELIMITER = ",";
 constexpr auto SECTION_KEY_SEP = "::";
+// estimated memory of a map node and its bookkeeping in a parsed ini file
+constexpr auto MAP_NODE_SIZE = 64;
+// milliseconds without further outside changes before a changed file is loaded again
+constexpr auto RELOAD_DELAY_MS = 250;
+// default milliseconds between two checks of a file in the ReadCache
+constexpr auto READ_CACHE_INTERVAL_MS = 1000;
+// default number of non-buffered reads of a file within AUTO_BUFFER_WINDOW_MS that promote it to the ReadCache
+constexpr auto AUTO_BUFFER_THRESHOLD = 10;
+constexpr auto AUTO_BUFFER_WINDOW_MS = 1000;
+// default milliseconds without non-buffered reads before a promoted file is demoted again
+constexpr auto AUTO_BUFFER_IDLE_MS = 30000;
+// milliseconds before a missing file or an existing directory is checked on the file system again
+constexpr auto FILE_METADATA_TTL_MS = 2000;
+// files buffered during the last session, loaded again at startup
+constexpr auto PREFETCH_PROFILE_FILE = "Data\\SKSE\\Plugins\\PapyrusIni\\Profile.ini";
+// directory of manifests declaring files to load at startup
+constexpr auto PREFETCH_MANIFEST_DIR = "Data\\SKSE\\Plugins\\PapyrusIni\\Prefetch";
+constexpr auto PREFETCH_SECTION = "Prefetch";
 
 namespace PapyrusIni {
 
+	SKSETaskInterface* g_taskInterface = nullptr;
+
+	void SetTaskInterface(SKSETaskInterface* taskInterface) {
+		g_taskInterface = taskInterface;
+	}
+
+	SKSEMessagingInterface* g_messagingInterface = nullptr;
+
+	void SetMessagingInterface(SKSEMessagingInterface* messagingInterface) {
+		g_messagingInterface = messagingInterface;
+	}
+
 	class Logger {
 	private:
 		static void WriteLine(std::string str) {
@@ -54,25 +111,145 @@ namespace PapyrusIni {
 		return "{" + path + "}[" + section + "]<" + key + ">";
 	}
 
+	/// <summary>
+	/// Sections and keys are case insensitive, so they are compared in lower case.
+	/// </summary>
+	std::string ToLower(std::string str) {
+		std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		return str;
+	}
+
+	std::string Trim(std::string str) {
+		auto begin = str.find_first_not_of(" \t");
+		if (begin == std::string::npos) {
+			return std::string();
+		}
+		return str.substr(begin, str.find_last_not_of(" \t") - begin + 1);
+	}
+
+	/// <summary>
+	/// Remembers which files are missing and which directories exist, so hot loops over missing files do not check the file system
+	/// or write to the log every time. Entries expire after FILE_METADATA_TTL_MS to notice changes by other programs.
+	/// Writes of this library forget that the file is missing immediately.
+	/// </summary>
+	class FileMetadata {
+	private:
+		std::mutex lock;
+		std::unordered_map<std::string, ULONGLONG> missingFiles;
+		std::unordered_map<std::string, ULONGLONG> directories;
+
+		static bool IsKnown(std::unordered_map<std::string, ULONGLONG>& entries, const std::string& path) {
+			auto it = entries.find(path);
+			if (it == entries.end()) {
+				return false;
+			}
+			if (GetTickCount64() - it->second >= FILE_METADATA_TTL_MS) {
+				entries.erase(it);
+				return false;
+			}
+			return true;
+		}
+	public:
+		static auto GetInstance() -> FileMetadata&
+		{
+			static FileMetadata instance;
+			return instance;
+		}
+
+		bool IsMissing(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			return IsKnown(missingFiles, path);
+		}
+
+		void SetMissing(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			missingFiles[path] = GetTickCount64();
+		}
+
+		bool IsDirectory(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			return IsKnown(directories, path);
+		}
+
+		void SetDirectory(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			directories[path] = GetTickCount64();
+		}
+
+		/// <summary>
+		/// Forgets that the file is missing, because it is written by this library.
+		/// </summary>
+		void FileWritten(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			missingFiles.erase(path);
+		}
+	};
+
 	class FileHelper {
 	public:
+		/// <summary>
+		/// Returns the last write time of a file or 0, if it does not exist.
+		/// </summary>
+		static long long GetWriteTime(const std::string& iniFile) {
+			std::error_code error;
+			auto time = std::filesystem::last_write_time(iniFile, error);
+			return error ? 0 : (long long)time.time_since_epoch().count();
+		}
+
+		/// <summary>
+		/// Returns the size of a file or 0, if it does not exist.
+		/// </summary>
+		static uintmax_t GetSize(const std::string& iniFile) {
+			std::error_code error;
+			auto size = std::filesystem::file_size(iniFile, error);
+			return error ? 0 : size;
+		}
+
+		/// <summary>
+		/// Called before every write of the file, so it also forgets that the file is missing.
+		/// </summary>
 		static void CreateParentDir(std::string& iniFile) {
+			FileMetadata::GetInstance().FileWritten(iniFile);
 			std::filesystem::path filePath(iniFile);
 			std::filesystem::path parentPath = filePath.parent_path();
+			if (FileMetadata::GetInstance().IsDirectory(parentPath.string())) {
+				return;
+			}
 			std::filesystem::directory_entry directory(parentPath);
 			if (!directory.exists()) {
 				std::filesystem::create_directories(parentPath);
 			}
+			FileMetadata::GetInstance().SetDirectory(parentPath.string());
 		}
 
-		static void FileCannotBeLoaded(std::string& iniFile) {
+		/// <summary>
+		/// Returns if the file was missing recently. Reads of such a file can return the default values without accessing it.
+		/// </summary>
+		static bool IsMissing(std::string& iniFile) {
+			return FileMetadata::GetInstance().IsMissing(iniFile);
+		}
+
+		/// <summary>
+		/// Returns true, if the file exists. Otherwise remembers that it is missing and logs it once per FILE_METADATA_TTL_MS.
+		/// </summary>
+		static bool Exists(std::string& iniFile) {
+			if (IsMissing(iniFile)) {
+				// already logged
+				return false;
+			}
 			std::filesystem::path filePath(iniFile);
 			std::filesystem::directory_entry iniEntry(filePath);
-			if (!iniEntry.exists()) {
-				Logger::Msg("File does not exist: " + iniFile);
-				Logger::Msg("\tDefault values will be used.");
+			if (iniEntry.exists()) {
+				return true;
 			}
-			else {
+			FileMetadata::GetInstance().SetMissing(iniFile);
+			Logger::Msg("File does not exist: " + iniFile);
+			Logger::Msg("\tDefault values will be used.");
+			return false;
+		}
+
+		static void FileCannotBeLoaded(std::string& iniFile) {
+			if (Exists(iniFile)) {
 				Logger::Error("Failed to parse file: " + iniFile);
 				Logger::Error("\tCheck that the file is not protected or corrupted.");
 			}
@@ -84,247 +261,4246 @@ namespace PapyrusIni {
 		}
 	};
 
-	class IniCache {
+	/// <summary>
+	/// Maps paths relative to the Data directory to a single canonical path per file, e.g. "Config\\A.ini", "config/a.ini" and "Config\\.\\A.ini"
+	/// all become "Data\\Config\\A.ini". Separators, "." and ".." are normalized and paths that only differ in case use the first spelling seen,
+	/// so new files are still created with the case the author used. All caches are keyed by the canonical path.
+	/// The result is cached per incoming string, so each spelling is only normalized once.
+	/// </summary>
+	class CanonicalPaths {
 	private:
-		std::string path;
-		CSimpleIniA ini;
-		bool modified = false;
+		std::shared_mutex lock;
+		// incoming path -> canonical path
+		std::unordered_map<std::string, std::string> canonical;
+		// case folded path -> canonical path
+		std::unordered_map<std::string, std::string> spellings;
+
+		static std::string Normalize(const std::string& path) {
+			std::vector<std::string> parts;
+			size_t start = 0;
+			while (start <= path.size()) {
+				auto end = path.find_first_of("\\/", start);
+				if (end == std::string::npos) {
+					end = path.size();
+				}
+				auto part = path.substr(start, end - start);
+				if (part.compare("..") == 0 && !parts.empty() && parts.back().compare("..") != 0) {
+					parts.pop_back();
+				}
+				else if (!part.empty() && part.compare(".") != 0) {
+					parts.push_back(part);
+				}
+				start = end + 1;
+			}
+			std::string result("Data");
+			for (auto& part : parts) {
+				result += "\\" + part;
+			}
+			return result;
+		}
 	public:
-		IniCache() = delete;
-		IniCache(const IniCache&) = delete;
-		IniCache(IniCache&&) = delete;
-		IniCache& operator=(IniCache&&) = delete;
-		IniCache& operator=(IniCache&) = delete;
+		static auto GetInstance() -> CanonicalPaths&
+		{
+			static CanonicalPaths instance;
+			return instance;
+		}
 
-		IniCache(std::string path) {
-			this->path = path;
-			Load();
+		/// <summary>
+		/// Returns the canonical path of a path relative to the Data directory.
+		/// </summary>
+		std::string Get(const std::string& path) {
+			{
+				std::shared_lock<std::shared_mutex> guard(lock);
+				auto it = canonical.find(path);
+				if (it != canonical.end()) {
+					return it->second;
+				}
+			}
+			auto normalized = Normalize(path);
+			std::unique_lock<std::shared_mutex> guard(lock);
+			auto& result = spellings.try_emplace(ToLower(normalized), normalized).first->second;
+			canonical[path] = result;
+			return result;
 		}
+	};
 
-		void Load() {
-			Logger::Msg("Load Cache: {" + path + "}");
-			SI_Error rc = ini.LoadFile(path.c_str());
-			if (rc < 0) {
-				FileHelper::FileCannotBeLoaded(path);
-				return;
+	/// <summary>
+	/// Looks up multiple settings in a parsed ini file. Sets found[i], if settings[i] exists.
+	/// Settings with an empty section or key are skipped.
+	/// </summary>
+	void ReadValues(CSimpleIniA& ini, std::vector<std::pair<std::string, std::string>>& settings, std::vector<std::string>& values, std::vector<bool>& found) {
+		for (size_t i = 0; i < settings.size(); i++) {
+			auto& section = settings[i].first;
+			auto& key = settings[i].second;
+			if (section.compare("") == 0 || key.compare("") == 0) {
+				continue;
+			}
+			auto value = ini.GetValue(section.c_str(), key.c_str(), nullptr);
+			if (value != nullptr) {
+				values[i] = value;
+				found[i] = true;
 			}
 		}
+	}
 
-		std::string Read(std::string section, std::string key, std::string& def) {
-			auto value = std::string(ini.GetValue(section.c_str(), key.c_str(), def.c_str()));
-			Logger::DebugMsg("Read Cache: " + IniAccess(path, section, key) + " value=" + value);
-			return value;
+	/// <summary>
+	/// Removes a pair of matching quotes around a value the way GetPrivateProfileStringA does.
+	/// </summary>
+	void RemoveQuotes(std::string& value) {
+		auto size = value.size();
+		if (size >= 2 && (value[0] == '"' || value[0] == '\'') && value[size - 1] == value[0]) {
+			value = value.substr(1, size - 2);
 		}
+	}
 
-		void Write(std::string& section, std::string& key, std::string& value) {
-			Logger::DebugMsg("Write Cache: " + IniAccess(path, section, key) + " value=" + value);
-			modified = true;
-			SI_Error rc = ini.SetValue(section.c_str(), key.c_str(), value.c_str());
-			if (rc < 0) {
-				Logger::Error("Failed to write buffer: " + path);
-				Logger::Error("\tThis is an error with PapyrusIni.Please report the bug.");
-				return;
+	/// <summary>
+	/// Looks up a value in a file parsed by ParseIniFile the way GetPrivateProfileStringA does:
+	/// the first of duplicate keys is used and a pair of matching quotes around the value is removed.
+	/// Returns false, if the key does not exist.
+	/// </summary>
+	bool GetFileValue(CSimpleIniA& ini, const std::string& section, const std::string& key, std::string& value) {
+		auto keyValues = ini.GetSection(section.c_str());
+		if (keyValues == nullptr) {
+			return false;
+		}
+		// duplicate keys are stored in file order, so the lower bound is the first one
+		auto it = keyValues->lower_bound(CSimpleIniA::Entry(key.c_str()));
+		if (it == keyValues->end() || keyValues->key_comp()(CSimpleIniA::Entry(key.c_str()), it->first)) {
+			return false;
+		}
+		value = it->second;
+		RemoveQuotes(value);
+		return true;
+	}
+
+	/// <summary>
+	/// Looks up multiple settings in a file parsed by ParseIniFile with GetFileValue. Sets found[i], if settings[i] exists.
+	/// </summary>
+	void ReadFileValues(CSimpleIniA& ini, std::vector<std::pair<std::string, std::string>>& settings, std::vector<std::string>& values, std::vector<bool>& found) {
+		for (size_t i = 0; i < settings.size(); i++) {
+			if (settings[i].first.compare("") != 0 && settings[i].second.compare("") != 0) {
+				found[i] = GetFileValue(ini, settings[i].first, settings[i].second, values[i]);
 			}
 		}
+	}
 
-		void Save() {
-			if (modified) {
-				Logger::Msg("Save Cache: {" + path + "} -> save");
-				FileHelper::CreateParentDir(path);
-				SI_Error rc = ini.SaveFile(path.c_str());
-				if (rc < 0) {
-					FileHelper::FileCannotBeSaved(path);
+	/// <summary>
+	/// Returns the number of distinct keys of a section in a parsed ini file.
+	/// </summary>
+	SInt32 CountSectionKeys(const CSimpleIniA::TKeyVal* keyValues) {
+		SInt32 count = 0;
+		if (keyValues != nullptr) {
+			for (auto it = keyValues->begin(); it != keyValues->end(); it = keyValues->upper_bound(it->first)) {
+				count++;
+			}
+		}
+		return count;
+	}
+
+	/// <summary>
+	/// Collects the keys and values of a section in a parsed ini file, starting at index start. At most count entries are collected.
+	/// The section map is iterated directly, so no intermediate list of key names is built.
+	/// Only the first of duplicate keys is collected, since files parsed by ParseIniFile keep them.
+	/// </summary>
+	void ReadSectionEntries(const CSimpleIniA::TKeyVal* keyValues, SInt32 start, SInt32 count, std::vector<std::string>* keys, std::vector<std::string>* values) {
+		if (keyValues == nullptr || start < 0 || count <= 0 || start >= (SInt32)keyValues->size()) {
+			return;
+		}
+		auto it = keyValues->begin();
+		for (SInt32 i = 0; i < start && it != keyValues->end(); i++) {
+			it = keyValues->upper_bound(it->first);
+		}
+		for (SInt32 i = 0; i < count && it != keyValues->end(); i++, it = keyValues->upper_bound(it->first)) {
+			if (keys != nullptr) {
+				keys->push_back(it->first.pItem);
+			}
+			if (values != nullptr) {
+				values->push_back(it->second);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Returns true, if str matches the pattern case insensitively. '*' matches any sequence of characters and '?' matches a single character.
+	/// </summary>
+	bool MatchPattern(std::string& str, std::string& pattern) {
+		size_t s = 0;
+		size_t p = 0;
+		size_t starPattern = std::string::npos;
+		size_t starStr = 0;
+		while (s < str.size()) {
+			if (p < pattern.size() && (pattern[p] == '?' || std::tolower((unsigned char)pattern[p]) == std::tolower((unsigned char)str[s]))) {
+				s++;
+				p++;
+			}
+			else if (p < pattern.size() && pattern[p] == '*') {
+				starPattern = p++;
+				starStr = s;
+			}
+			else if (starPattern != std::string::npos) {
+				p = starPattern + 1;
+				s = ++starStr;
+			}
+			else {
+				return false;
+			}
+		}
+		while (p < pattern.size() && pattern[p] == '*') {
+			p++;
+		}
+		return p == pattern.size();
+	}
+
+	/// <summary>
+	/// Collects the keys of a section in a parsed ini file that start with prefix and match pattern, if pattern is not empty.
+	/// The keys of a section are sorted case insensitively, so only the range of keys starting with prefix is scanned.
+	/// At most MAX_ARRAY_SIZE keys are collected.
+	/// </summary>
+	void FindSectionKeys(const CSimpleIniA::TKeyVal* keyValues, std::string& prefix, std::string& pattern, std::vector<std::string>& keys) {
+		if (keyValues == nullptr) {
+			return;
+		}
+		auto lowerPrefix = ToLower(prefix);
+		for (auto it = keyValues->lower_bound(CSimpleIniA::Entry(prefix.c_str())); it != keyValues->end() && keys.size() < MAX_ARRAY_SIZE; it = keyValues->upper_bound(it->first)) {
+			std::string key = it->first.pItem;
+			if (ToLower(key.substr(0, prefix.size())).compare(lowerPrefix) != 0) {
+				break;
+			}
+			if (pattern.compare("") == 0 || MatchPattern(key, pattern)) {
+				keys.push_back(key);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Sets the keys of a section in a parsed ini file. If replace is true, all other keys are removed from the section.
+	/// Values that do not change are not copied again. Returns true, if the ini file was changed.
+	/// </summary>
+	bool WriteSectionEntries(CSimpleIniA& ini, std::string& section, std::vector<std::string>& keys, std::vector<std::string>& values, bool replace) {
+		bool changed = false;
+		if (replace) {
+			auto keyValues = ini.GetSection(section.c_str());
+			if (keyValues != nullptr) {
+				std::unordered_set<std::string> newKeys;
+				for (auto& key : keys) {
+					newKeys.insert(ToLower(key));
+				}
+				std::vector<std::string> staleKeys;
+				for (auto& it : *keyValues) {
+					if (newKeys.find(ToLower(it.first.pItem)) == newKeys.end()) {
+						staleKeys.push_back(it.first.pItem);
+					}
 				}
+				for (auto& key : staleKeys) {
+					ini.Delete(section.c_str(), key.c_str());
+					changed = true;
+				}
+			}
+		}
+		for (size_t i = 0; i < keys.size() && i < values.size(); i++) {
+			if (keys[i].compare("") == 0) {
+				continue;
+			}
+			auto oldValue = ini.GetValue(section.c_str(), keys[i].c_str(), nullptr);
+			if (oldValue == nullptr || values[i].compare(oldValue) != 0) {
+				// replaces the first of duplicate keys in files loaded with SetMultiKey
+				ini.SetValue(section.c_str(), keys[i].c_str(), values[i].c_str(), nullptr, true);
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	/// <summary>
+	/// Splits a list value at the delimiter and trims whitespace around the elements. An empty value is an empty list.
+	/// Single character delimiters are found with memchr, which is vectorized by the C runtime.
+	/// </summary>
+	std::vector<std::string> SplitList(std::string value, std::string delimiter) {
+		std::vector<std::string> elements;
+		if (delimiter.compare("") == 0) {
+			delimiter = LIST_DELIMITER;
+		}
+		const char* begin = value.c_str();
+		const char* end = begin + value.size();
+		while (begin < end && std::isspace((unsigned char)*begin)) {
+			begin++;
+		}
+		if (begin == end) {
+			return elements;
+		}
+		while (true) {
+			const char* next;
+			if (delimiter.size() == 1) {
+				next = (const char*)std::memchr(begin, delimiter[0], end - begin);
 			}
 			else {
-				Logger::Msg("Save Cache: {" + path + "} -> no changes");
+				auto index = value.find(delimiter, begin - value.c_str());
+				next = index == std::string::npos ? nullptr : value.c_str() + index;
+			}
+			const char* elementBegin = begin;
+			const char* elementEnd = next != nullptr ? next : end;
+			while (elementBegin < elementEnd && std::isspace((unsigned char)*elementBegin)) {
+				elementBegin++;
+			}
+			while (elementEnd > elementBegin && std::isspace((unsigned char)*(elementEnd - 1))) {
+				elementEnd--;
 			}
+			elements.emplace_back(elementBegin, elementEnd);
+			if (next == nullptr) {
+				break;
+			}
+			begin = next + delimiter.size();
 		}
-	};
+		return elements;
+	}
 
+	std::string JoinList(std::vector<std::string>& elements, std::string delimiter) {
+		if (delimiter.compare("") == 0) {
+			delimiter = LIST_DELIMITER;
+		}
+		std::string value;
+		for (size_t i = 0; i < elements.size(); i++) {
+			if (i > 0) {
+				value += delimiter;
+			}
+			value += elements[i];
+		}
+		return value;
+	}
 
-	class IniHandler {
+	/// <summary>
+	/// Converts list elements to integers. Elements that are not integers are 0.
+	/// </summary>
+	std::vector<SInt32> ToIntList(std::vector<std::string>& elements) {
+		std::vector<SInt32> result;
+		result.reserve(elements.size());
+		for (auto& element : elements) {
+			SInt32 value = 0;
+			const char* begin = element.c_str();
+			if (*begin == '+') {
+				begin++;
+			}
+			auto end = element.c_str() + element.size();
+			auto parsed = std::from_chars(begin, end, value);
+			// elements with trailing characters or out of range are not numbers
+			if (parsed.ptr != end || parsed.ec != std::errc()) {
+				value = 0;
+			}
+			result.push_back(value);
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// Converts list elements to floats. Elements that are not numbers are 0.0.
+	/// </summary>
+	std::vector<float> ToFloatList(std::vector<std::string>& elements) {
+		std::vector<float> result;
+		result.reserve(elements.size());
+		for (auto& element : elements) {
+			float value = 0.0;
+			const char* begin = element.c_str();
+			if (*begin == '+') {
+				begin++;
+			}
+			auto end = element.c_str() + element.size();
+			auto parsed = std::from_chars(begin, end, value);
+			if (parsed.ptr != end || parsed.ec != std::errc()) {
+				value = 0.0;
+			}
+			result.push_back(value);
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// Optional global index from section and key to the files defining them.
+	/// It contains all files that were loaded into an IniCache or written while the index was enabled.
+	/// </summary>
+	class KeyIndex {
 	private:
-		std::unordered_map <  std::string, std::unique_ptr<IniCache>> fileReaders;
+		std::atomic<bool> enabled = false;
+		std::mutex lock;
+		// lower case "section::key" -> paths of the files defining it
+		std::unordered_map<std::string, std::set<std::string>> files;
+		// path -> lower case "section::key" of all keys defined by the file
+		std::unordered_map<std::string, std::unordered_set<std::string>> keys;
+
+		static std::string KeyId(std::string section, std::string key) {
+			return ToLower(section + SECTION_KEY_SEP + key);
+		}
+
+		void RemoveFile(std::string& path) {
+			auto fileKeys = keys.find(path);
+			if (fileKeys == keys.end()) {
+				return;
+			}
+			for (auto& id : fileKeys->second) {
+				auto keyFiles = files.find(id);
+				if (keyFiles != files.end()) {
+					keyFiles->second.erase(path);
+					if (keyFiles->second.empty()) {
+						files.erase(keyFiles);
+					}
+				}
+			}
+			keys.erase(fileKeys);
+		}
 	public:
-		static auto GetInstance() -> IniHandler&
+		static auto GetInstance() -> KeyIndex&
 		{
-			static IniHandler instance;
+			static KeyIndex instance;
 			return instance;
 		}
 
+		bool IsEnabled() {
+			return enabled;
+		}
+
 		/// <summary>
-		/// Returns true, if a IniCache exists for the specified path.
+		/// Enables or disables the index. Disabling the index frees its memory.
 		/// </summary>
-		/// <param name="path">Path to the .ini file.</param>
-		/// <returns></returns>
-		bool HasIniCache(std::string path) {
-			Logger::DebugMsg("HasIniCache: {" + path + "} -> return " + std::to_string(fileReaders.find(path) != fileReaders.end()));
-			return fileReaders.find(path) != fileReaders.end();
+		void SetEnabled(bool enabled) {
+			std::lock_guard<std::mutex> guard(lock);
+			this->enabled = enabled;
+			if (!enabled) {
+				files.clear();
+				keys.clear();
+			}
 		}
 
 		/// <summary>
-		/// Returns a IniCache for the specified path. If it does not exist, a new one is created.
+		/// Replaces the indexed keys of a file with all keys of the parsed ini file.
+		/// Keys of [Child : Base] sections are indexed under the child, if the file uses @inherit.
 		/// </summary>
-		/// <param name="path">Path to the .ini file.</param>
-		/// <returns>A IniCache containing all values of the .ini file.</returns>
-		IniCache& GetIniCache(std::string path) {
-			if (fileReaders.find(path) == fileReaders.end()) {
-				Logger::DebugMsg("GetIniCache: {" + path + "} -> get new");
-				fileReaders.emplace(path, std::make_unique<IniCache>(path));
+		void IndexFile(std::string& path, CSimpleIniA& ini) {
+			if (!enabled) {
+				return;
 			}
-			else {
-				Logger::DebugMsg("GetIniCache: {" + path + "} -> get existing");
+			bool inherit = ini.GetBoolValue("", "@inherit", false);
+			std::lock_guard<std::mutex> guard(lock);
+			RemoveFile(path);
+			auto& fileKeys = keys[path];
+			CSimpleIniA::TNamesDepend sections;
+			ini.GetAllSections(sections);
+			for (auto& section : sections) {
+				std::string name = section.pItem;
+				auto colonIndex = name.find(':');
+				if (inherit && colonIndex != std::string::npos) {
+					name = Trim(name.substr(0, colonIndex));
+				}
+				auto keyValues = ini.GetSection(section.pItem);
+				for (auto& it : *keyValues) {
+					auto id = KeyId(name, it.first.pItem);
+					fileKeys.insert(id);
+					files[id].insert(path);
+				}
+			}
+		}
+
+		void Add(std::string& path, std::string& section, std::string& key) {
+			if (!enabled) {
+				return;
 			}
-			return *fileReaders.at(path).get();
+			std::lock_guard<std::mutex> guard(lock);
+			auto id = KeyId(section, key);
+			keys[path].insert(id);
+			files[id].insert(path);
 		}
 
 		/// <summary>
-		/// Closes the IniCache for the specified path, writing the changes and freeing memory.
+		/// Returns the paths of all indexed files defining the key, sorted alphabetically.
 		/// </summary>
-		/// <param name="path">Path to the .ini file.</param>
-		void CloseIniCache(std::string path) {
-			if (fileReaders.find(path) != fileReaders.end()) {
-				Logger::DebugMsg("CloseIniCache: {" + path + "} -> close existing");
-				fileReaders[path].get()->Save();
-				fileReaders.erase(path);
-			}
-			else {
-				Logger::DebugMsg("CloseIniCache: {" + path + "} -> does not exist");
+		std::vector<std::string> Find(std::string& section, std::string& key) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto keyFiles = files.find(KeyId(section, key));
+			if (keyFiles == files.end()) {
+				return std::vector<std::string>();
 			}
+			return std::vector<std::string>(keyFiles->second.begin(), keyFiles->second.end());
 		}
+	};
 
+	/// <summary>
+	/// Immutable copy of the keys, values and comments of a section.
+	/// </summary>
+	struct SectionSnapshot {
+		struct Entry {
+			std::string key;
+			std::string value;
+			std::string comment;
+		};
+		std::string section;
+		std::string comment;
+		std::vector<Entry> entries;
+	};
 
+	/// <summary>
+	/// Immutable copy of all sections of an IniCache. Sections that did not change between two snapshots are shared.
+	/// </summary>
+	struct IniSnapshot {
+		std::string path;
+		std::vector<std::shared_ptr<const SectionSnapshot>> sections;
 	};
 
-	void CreateCache(std::string& fileName) {
-		IniHandler::GetInstance().GetIniCache(fileName);
+	/// <summary>
+	/// Copies a section of a parsed ini file, keeping the order of its keys.
+	/// </summary>
+	std::shared_ptr<SectionSnapshot> CopySectionEntries(CSimpleIniA& ini, const CSimpleIniA::Entry& section) {
+		auto sectionSnapshot = std::make_shared<SectionSnapshot>();
+		sectionSnapshot->section = section.pItem;
+		sectionSnapshot->comment = section.pComment != nullptr ? section.pComment : "";
+		CSimpleIniA::TNamesDepend keys;
+		ini.GetAllKeys(section.pItem, keys);
+		keys.sort(CSimpleIniA::Entry::LoadOrder());
+		for (auto& key : keys) {
+			sectionSnapshot->entries.push_back(SectionSnapshot::Entry{ key.pItem, ini.GetValue(section.pItem, key.pItem, ""), key.pComment != nullptr ? key.pComment : "" });
+		}
+		return sectionSnapshot;
 	}
 
-	void WriteCache(std::string& fileName) {
-		if (IniHandler::GetInstance().HasIniCache(fileName)) {
-			IniHandler::GetInstance().GetIniCache(fileName).Save();
+	/// <summary>
+	/// Copies the sections of a file parsed by ParseIniFile in the order of the file. If section is not empty, only that section is copied.
+	/// Quotes around the values are removed like GetFileValue does, so the copied values are the values non-buffered reads return.
+	/// </summary>
+	void CopySections(CSimpleIniA& ini, std::string& section, IniSnapshot& snapshot) {
+		CSimpleIniA::TNamesDepend sections;
+		ini.GetAllSections(sections);
+		sections.sort(CSimpleIniA::Entry::LoadOrder());
+		auto lowerSection = ToLower(section);
+		for (auto& it : sections) {
+			if (section.compare("") == 0 || ToLower(it.pItem).compare(lowerSection) == 0) {
+				auto sectionSnapshot = CopySectionEntries(ini, it);
+				for (auto& entry : sectionSnapshot->entries) {
+					RemoveQuotes(entry.value);
+				}
+				snapshot.sections.push_back(sectionSnapshot);
+			}
 		}
 	}
 
-	void CloseCache(std::string& fileName) {
-		IniHandler::GetInstance().CloseIniCache(fileName);
+	/// <summary>
+	/// Adds the sections of a snapshot to a parsed ini file in a single pass.
+	/// If overwrite is false, values that already exist in the file are not changed. Returns true, if the ini file was changed.
+	/// </summary>
+	bool MergeSectionEntries(CSimpleIniA& ini, const IniSnapshot& snapshot, bool overwrite) {
+		bool changed = false;
+		for (auto& section : snapshot.sections) {
+			if (ini.GetSection(section->section.c_str()) == nullptr) {
+				ini.SetValue(section->section.c_str(), nullptr, nullptr, section->comment.empty() ? nullptr : section->comment.c_str());
+				changed = true;
+			}
+			for (auto& entry : section->entries) {
+				auto oldValue = ini.GetValue(section->section.c_str(), entry.key.c_str(), nullptr);
+				if (oldValue == nullptr || (overwrite && entry.value.compare(oldValue) != 0)) {
+					ini.SetValue(section->section.c_str(), entry.key.c_str(), entry.value.c_str(), entry.comment.empty() ? nullptr : entry.comment.c_str());
+					changed = true;
+				}
+			}
+		}
+		return changed;
+	}
+
+	/// <summary>
+	/// Estimates the memory used by a parsed ini file from the lengths of its strings and the number of map nodes.
+	/// </summary>
+	size_t EstimateIniSize(CSimpleIniA& ini) {
+		size_t size = sizeof(CSimpleIniA);
+		CSimpleIniA::TNamesDepend sections;
+		ini.GetAllSections(sections);
+		for (auto& section : sections) {
+			size += MAP_NODE_SIZE + std::strlen(section.pItem) + 1;
+			if (section.pComment != nullptr) {
+				size += std::strlen(section.pComment) + 1;
+			}
+			for (auto& it : *ini.GetSection(section.pItem)) {
+				size += MAP_NODE_SIZE + std::strlen(it.first.pItem) + std::strlen(it.second) + 2;
+				if (it.first.pComment != nullptr) {
+					size += std::strlen(it.first.pComment) + 1;
+				}
+			}
+		}
+		return size;
+	}
+
+	/// <summary>
+	/// Graph of the @include directives of all loaded files. Used to reject include cycles and to find the files that depend on a changed file.
+	/// </summary>
+	class IncludeGraph {
+	private:
+		std::mutex lock;
+		// path -> paths of the files it includes
+		std::unordered_map<std::string, std::set<std::string>> includes;
+		// path -> paths of the files including it
+		std::unordered_map<std::string, std::set<std::string>> dependents;
+
+		/// <summary>
+		/// Returns true, if target can be reached from path by following includes. Must be called with the lock held.
+		/// </summary>
+		bool Reaches(const std::string& path, const std::string& target, std::unordered_set<std::string>& visited) {
+			if (path.compare(target) == 0) {
+				return true;
+			}
+			if (!visited.insert(path).second) {
+				return false;
+			}
+			auto it = includes.find(path);
+			if (it == includes.end()) {
+				return false;
+			}
+			for (auto& include : it->second) {
+				if (Reaches(include, target, visited)) {
+					return true;
+				}
+			}
+			return false;
+		}
+	public:
+		static auto GetInstance() -> IncludeGraph&
+		{
+			static IncludeGraph instance;
+			return instance;
+		}
+
+		/// <summary>
+		/// Adds an include of a file. Returns false and does not add it, if it would create a cycle.
+		/// </summary>
+		bool Add(std::string& path, std::string& include) {
+			std::lock_guard<std::mutex> guard(lock);
+			std::unordered_set<std::string> visited;
+			if (Reaches(include, path, visited)) {
+				return false;
+			}
+			includes[path].insert(include);
+			dependents[include].insert(path);
+			return true;
+		}
+
+		/// <summary>
+		/// Removes all includes of a file, before they are read again or when its cache is closed.
+		/// </summary>
+		void RemoveIncludes(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto it = includes.find(path);
+			if (it == includes.end()) {
+				return;
+			}
+			for (auto& include : it->second) {
+				auto includeDependents = dependents.find(include);
+				if (includeDependents != dependents.end()) {
+					includeDependents->second.erase(path);
+					if (includeDependents->second.empty()) {
+						dependents.erase(includeDependents);
+					}
+				}
+			}
+			includes.erase(it);
+		}
+
+		std::vector<std::string> GetDependents(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto it = dependents.find(path);
+			if (it == dependents.end()) {
+				return std::vector<std::string>();
+			}
+			return std::vector<std::string>(it->second.begin(), it->second.end());
+		}
+	};
+
+	/// <summary>
+	/// Returns the settings referenced by ${key:section} in a value as pairs of section and key.
+	/// References without a section, e.g. ${key}, refer to a key of the same section.
+	/// </summary>
+	std::vector<std::pair<std::string, std::string>> FindReferences(const std::string& value, const std::string& section) {
+		std::vector<std::pair<std::string, std::string>> references;
+		size_t pos = 0;
+		while (true) {
+			auto begin = value.find("${", pos);
+			if (begin == std::string::npos) {
+				break;
+			}
+			auto end = value.find('}', begin);
+			if (end == std::string::npos) {
+				break;
+			}
+			auto reference = value.substr(begin + 2, end - begin - 2);
+			auto colonIndex = reference.find(':');
+			if (colonIndex == std::string::npos) {
+				references.push_back(std::make_pair(section, Trim(reference)));
+			}
+			else {
+				references.push_back(std::make_pair(Trim(reference.substr(colonIndex + 1)), Trim(reference.substr(0, colonIndex))));
+			}
+			pos = end + 1;
+		}
+		return references;
+	}
+
+	/// <summary>
+	/// Values of a section after resolving inheritance and includes.
+	/// </summary>
+	struct FlatSection {
+		// lower case key -> value
+		std::unordered_map<std::string, std::string> values;
+	};
+
+	/// <summary>
+	/// Parses a file for non-buffered reads. Duplicate keys are kept, so GetFileValue can use the first one like GetPrivateProfileStringA.
+	/// Returns nullptr, if the file cannot be loaded.
+	/// </summary>
+	std::shared_ptr<CSimpleIniA> ParseIniFile(std::string& path) {
+		auto ini = std::make_shared<CSimpleIniA>();
+		ini->SetMultiKey(true);
+		if (ini->LoadFile(path.c_str()) < 0) {
+			FileHelper::FileCannotBeLoaded(path);
+			return nullptr;
+		}
+		return ini;
+	}
+
+	/// <summary>
+	/// Optional cache of parsed files for non-buffered reads. Unlike an IniCache, it does not keep outside changes or writes from being read:
+	/// an entry is parsed again, when the size or last write time of the file changed, and it is removed, when the file is written.
+	/// While enabled, the file is checked at most once per interval, so outside changes may be seen up to one interval late.
+	/// Files promoted by the AutoBuffer are also kept while it is disabled, but they are checked on every read.
+	/// </summary>
+	class ReadCache {
+	private:
+		struct Entry {
+			// nullptr, if the file could not be loaded
+			std::shared_ptr<CSimpleIniA> ini;
+			uintmax_t size = 0;
+			long long time = 0;
+			ULONGLONG checkedAt = 0;
+		};
+
+		std::atomic<bool> enabled = false;
+		std::atomic<UInt32> interval = READ_CACHE_INTERVAL_MS;
+		std::mutex lock;
+		std::unordered_map<std::string, Entry> entries;
+	public:
+		static auto GetInstance() -> ReadCache&
+		{
+			static ReadCache instance;
+			return instance;
+		}
+
+		bool IsEnabled() {
+			return enabled;
+		}
+
+		/// <summary>
+		/// Enables or disables the cache. Disabling the cache frees its memory.
+		/// </summary>
+		void SetEnabled(bool enabled, UInt32 interval) {
+			std::lock_guard<std::mutex> guard(lock);
+			this->enabled = enabled;
+			this->interval = interval;
+			if (!enabled) {
+				entries.clear();
+			}
+		}
+
+		/// <summary>
+		/// Returns the parsed file or nullptr, if it cannot be loaded. The result must only be read.
+		/// </summary>
+		std::shared_ptr<CSimpleIniA> Get(std::string& path) {
+			auto now = GetTickCount64();
+			UInt32 checkInterval = enabled ? interval.load() : 0;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = entries.find(path);
+				if (it != entries.end() && now - it->second.checkedAt < checkInterval) {
+					return it->second.ini;
+				}
+			}
+			auto size = FileHelper::GetSize(path);
+			auto time = FileHelper::GetWriteTime(path);
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = entries.find(path);
+				if (it != entries.end() && it->second.size == size && it->second.time == time) {
+					it->second.checkedAt = now;
+					return it->second.ini;
+				}
+			}
+			Logger::DebugMsg("ReadCache: {" + path + "} -> parse");
+			auto ini = ParseIniFile(path);
+			std::lock_guard<std::mutex> guard(lock);
+			entries[path] = Entry{ ini, size, time, now };
+			return ini;
+		}
+
+		/// <summary>
+		/// Removes the entry of a file, because it was written or is not read often enough anymore.
+		/// </summary>
+		void Invalidate(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			entries.erase(path);
+		}
+	};
+
+	/// <summary>
+	/// Counts the non-buffered reads of each file. A file that is read at least threshold times within AUTO_BUFFER_WINDOW_MS is promoted
+	/// and read from the ReadCache, until it was not read for idleTime. Writes are not affected, so they are still written to the file immediately.
+	/// </summary>
+	class AutoBuffer {
+	private:
+		struct Rate {
+			ULONGLONG windowStart = 0;
+			ULONGLONG lastAccess = 0;
+			UInt32 count = 0;
+			bool promoted = false;
+		};
+
+		std::atomic<bool> enabled = false;
+		UInt32 threshold = AUTO_BUFFER_THRESHOLD;
+		UInt32 idleTime = AUTO_BUFFER_IDLE_MS;
+		ULONGLONG lastSweep = 0;
+		std::mutex lock;
+		std::unordered_map<std::string, Rate> rates;
+
+		/// <summary>
+		/// Removes idle files and returns the promoted ones among them. Must be called with the lock held.
+		/// </summary>
+		std::vector<std::string> Sweep(ULONGLONG now) {
+			std::vector<std::string> demoted;
+			for (auto it = rates.begin(); it != rates.end();) {
+				if (now - it->second.lastAccess < idleTime) {
+					++it;
+					continue;
+				}
+				if (it->second.promoted) {
+					Logger::Msg("AutoBuffer: {" + it->first + "} -> demoted after " + std::to_string(idleTime) + "ms without reads");
+					demoted.push_back(it->first);
+				}
+				it = rates.erase(it);
+			}
+			return demoted;
+		}
+	public:
+		static auto GetInstance() -> AutoBuffer&
+		{
+			static AutoBuffer instance;
+			return instance;
+		}
+
+		/// <summary>
+		/// Enables or disables the promotion of files. Disabling it demotes all promoted files.
+		/// </summary>
+		void SetEnabled(bool enabled, UInt32 threshold, UInt32 idleTime) {
+			std::vector<std::string> demoted;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				this->enabled = enabled;
+				this->threshold = (std::max)(threshold, (UInt32)1);
+				this->idleTime = idleTime;
+				if (!enabled) {
+					for (auto& rate : rates) {
+						if (rate.second.promoted) {
+							demoted.push_back(rate.first);
+						}
+					}
+					rates.clear();
+				}
+			}
+			for (auto& path : demoted) {
+				ReadCache::GetInstance().Invalidate(path);
+			}
+		}
+
+		/// <summary>
+		/// Counts a non-buffered read of the file and returns if it is promoted.
+		/// </summary>
+		bool Access(std::string& path) {
+			if (!enabled) {
+				return false;
+			}
+			auto now = GetTickCount64();
+			bool promoted;
+			std::vector<std::string> demoted;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto& rate = rates[path];
+				if (now - rate.windowStart >= AUTO_BUFFER_WINDOW_MS) {
+					rate.windowStart = now;
+					rate.count = 0;
+				}
+				rate.count++;
+				rate.lastAccess = now;
+				if (!rate.promoted && rate.count >= threshold) {
+					rate.promoted = true;
+					Logger::Msg("AutoBuffer: {" + path + "} -> promoted after " + std::to_string(rate.count) + " reads within " + std::to_string(AUTO_BUFFER_WINDOW_MS) + "ms");
+				}
+				promoted = rate.promoted;
+				if (now - lastSweep >= AUTO_BUFFER_WINDOW_MS) {
+					lastSweep = now;
+					demoted = Sweep(now);
+				}
+			}
+			for (auto& file : demoted) {
+				ReadCache::GetInstance().Invalidate(file);
+			}
+			return promoted;
+		}
+
+		/// <summary>
+		/// Returns all promoted files.
+		/// </summary>
+		std::vector<std::string> GetPromoted() {
+			std::lock_guard<std::mutex> guard(lock);
+			std::vector<std::string> files;
+			for (auto& rate : rates) {
+				if (rate.second.promoted) {
+					files.push_back(rate.first);
+				}
+			}
+			std::sort(files.begin(), files.end());
+			return files;
+		}
+	};
+
+	/// <summary>
+	/// Returns if a non-buffered read of the file should use the ReadCache and counts the read for the AutoBuffer.
+	/// </summary>
+	bool UseReadCache(std::string& path) {
+		bool promoted = AutoBuffer::GetInstance().Access(path);
+		return promoted || ReadCache::GetInstance().IsEnabled();
+	}
+
+	/// <summary>
+	/// Parses a file for a non-buffered read, using the ReadCache if it is enabled or the file is promoted. Returns nullptr, if the file cannot be loaded.
+	/// </summary>
+	std::shared_ptr<CSimpleIniA> LoadIniFile(std::string& path) {
+		if (FileHelper::IsMissing(path)) {
+			return nullptr;
+		}
+		if (UseReadCache(path)) {
+			return ReadCache::GetInstance().Get(path);
+		}
+		return ParseIniFile(path);
+	}
+
+	/// <summary>
+	/// Generations of files and sections. A generation increases whenever the values of the file or section may have changed,
+	/// which is on every write and every reload of a buffer. Generations are kept after buffers are closed, so they never decrease.
+	/// </summary>
+	class Generations {
+	private:
+		struct FileGeneration {
+			UInt32 file = 0;
+			// generation of the last change of all sections
+			UInt32 all = 0;
+			// lower case section -> generation
+			std::unordered_map<std::string, UInt32> sections;
+		};
+
+		std::mutex lock;
+		UInt32 counter = 0;
+		std::unordered_map<std::string, FileGeneration> files;
+	public:
+		static auto GetInstance() -> Generations&
+		{
+			static Generations instance;
+			return instance;
+		}
+
+		void Changed(const std::string& path, const std::vector<std::string>& lowerSections) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto generation = ++counter;
+			auto& file = files[path];
+			file.file = generation;
+			for (auto& section : lowerSections) {
+				file.sections[section] = generation;
+			}
+		}
+
+		void ChangedAll(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto generation = ++counter;
+			auto& file = files[path];
+			file.file = generation;
+			file.all = generation;
+			file.sections.clear();
+		}
+
+		UInt32 GetFile(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto it = files.find(path);
+			return it != files.end() ? it->second.file : 0;
+		}
+
+		UInt32 GetSection(const std::string& path, const std::string& section) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto it = files.find(path);
+			if (it == files.end()) {
+				return 0;
+			}
+			auto sectionIt = it->second.sections.find(ToLower(section));
+			return (std::max)(it->second.all, sectionIt != it->second.sections.end() ? sectionIt->second : 0);
+		}
+	};
+
+	/// <summary>
+	/// Receives the change notifications of the ChangeNotifier.
+	/// </summary>
+	class ChangeEventSink {
+	public:
+		virtual ~ChangeEventSink() {}
+		virtual void Send(const std::string& eventName, const std::string& strArg, float numArg) = 0;
+	};
+
+	/// <summary>
+	/// Sends change notifications to papyrus as ModEvents.
+	/// </summary>
+	class ModEventSink : public ChangeEventSink {
+	public:
+		virtual void Send(const std::string& eventName, const std::string& strArg, float numArg) {
+			if (g_messagingInterface == nullptr) {
+				return;
+			}
+			auto dispatcher = (EventDispatcher<SKSEModCallbackEvent>*)g_messagingInterface->GetEventDispatcher(SKSEMessagingInterface::kDispatcher_ModEvent);
+			if (dispatcher == nullptr) {
+				return;
+			}
+			SKSEModCallbackEvent event(BSFixedString(eventName.c_str()), BSFixedString(strArg.c_str()), numArg, nullptr);
+			dispatcher->SendEvent(&event);
+		}
+	};
+
+	/// <summary>
+	/// Notifies subscribers about changes of settings and sections.
+	/// Changes are collected and dispatched at the end of the frame, so each subscription receives at most one event per frame.
+	/// Setting subscriptions only receive an event, if the value of the setting is different from the value of their last event.
+	/// </summary>
+	class ChangeNotifier {
+	private:
+		struct Subscription {
+			// lower case, key is empty for section subscriptions
+			std::string section;
+			std::string key;
+			// sent as strArg of the event
+			std::string name;
+			std::string eventName;
+			std::string lastValue;
+		};
+
+		std::mutex lock;
+		// path -> subscriptions
+		std::unordered_map<std::string, std::vector<Subscription>> subscriptions;
+		// path -> lower case sections changed since the last dispatch
+		std::unordered_map<std::string, std::unordered_set<std::string>> changed;
+		// path -> lower case section -> lower case keys changed since the last dispatch, without changing the rest of the section
+		std::unordered_map<std::string, std::unordered_map<std::string, std::unordered_set<std::string>>> changedKeys;
+		// paths of which all sections changed since the last dispatch
+		std::unordered_set<std::string> allChanged;
+		bool dispatchScheduled = false;
+		const std::shared_ptr<ChangeEventSink> sink = std::make_shared<ModEventSink>();
+
+		class DispatchTask : public TaskDelegate {
+		public:
+			virtual void Run() {
+				ChangeNotifier::GetInstance().Dispatch();
+			}
+			virtual void Dispose() {
+				delete this;
+			}
+		};
+
+		/// <summary>
+		/// Dispatches the changes at the end of the frame. If no task interface is available, they are dispatched immediately.
+		/// Must be called with the lock held and returns true, if they must be dispatched immediately after releasing it.
+		/// </summary>
+		bool Schedule() {
+			if (g_taskInterface == nullptr) {
+				return true;
+			}
+			if (!dispatchScheduled) {
+				dispatchScheduled = true;
+				g_taskInterface->AddTask(new DispatchTask());
+			}
+			return false;
+		}
+	public:
+		static auto GetInstance() -> ChangeNotifier&
+		{
+			static ChangeNotifier instance;
+			return instance;
+		}
+
+		/// <summary>
+		/// Sends an event, which is not a change notification, to the sink.
+		/// </summary>
+		void Send(const std::string& eventName, const std::string& strArg, float numArg) {
+			sink->Send(eventName, strArg, numArg);
+		}
+
+		/// <summary>
+		/// Adds a subscription. value is the current value of the setting or "" for section subscriptions.
+		/// </summary>
+		void Subscribe(const std::string& path, const std::string& section, const std::string& key, const std::string& name, const std::string& eventName, const std::string& value) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto& fileSubscriptions = subscriptions[path];
+			auto lowerSection = ToLower(section);
+			auto lowerKey = ToLower(key);
+			for (auto& subscription : fileSubscriptions) {
+				if (subscription.section == lowerSection && subscription.key == lowerKey && subscription.eventName == eventName) {
+					return;
+				}
+			}
+			fileSubscriptions.push_back(Subscription{ lowerSection, lowerKey, name, eventName, value });
+		}
+
+		/// <summary>
+		/// Removes all subscriptions of the file with the event name.
+		/// </summary>
+		void Unsubscribe(const std::string& path, const std::string& eventName) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto it = subscriptions.find(path);
+			if (it == subscriptions.end()) {
+				return;
+			}
+			auto& fileSubscriptions = it->second;
+			fileSubscriptions.erase(std::remove_if(fileSubscriptions.begin(), fileSubscriptions.end(),
+				[&eventName](Subscription& subscription) { return subscription.eventName == eventName; }), fileSubscriptions.end());
+			if (fileSubscriptions.empty()) {
+				subscriptions.erase(it);
+			}
+		}
+
+		void Changed(const std::string& path, const std::vector<std::string>& lowerSections) {
+			bool dispatch;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (subscriptions.find(path) == subscriptions.end()) {
+					return;
+				}
+				changed[path].insert(lowerSections.begin(), lowerSections.end());
+				dispatch = Schedule();
+			}
+			if (dispatch) {
+				Dispatch();
+			}
+		}
+
+		/// <summary>
+		/// Like Changed, but only the settings changed, so subscriptions of other settings of their sections are not affected.
+		/// </summary>
+		void Changed(const std::string& path, const std::vector<std::pair<std::string, std::string>>& settings) {
+			bool dispatch;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (subscriptions.find(path) == subscriptions.end()) {
+					return;
+				}
+				auto& fileKeys = changedKeys[path];
+				for (auto& setting : settings) {
+					fileKeys[ToLower(setting.first)].insert(ToLower(setting.second));
+				}
+				dispatch = Schedule();
+			}
+			if (dispatch) {
+				Dispatch();
+			}
+		}
+
+		void ChangedAll(const std::string& path) {
+			bool dispatch;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (subscriptions.find(path) == subscriptions.end()) {
+					return;
+				}
+				allChanged.insert(path);
+				dispatch = Schedule();
+			}
+			if (dispatch) {
+				Dispatch();
+			}
+		}
+
+		void Dispatch();
+	};
+
+	/// <summary>
+	/// Sends an event from a background thread at the end of the frame.
+	/// </summary>
+	class SendEventTask : public TaskDelegate {
+	private:
+		std::string eventName;
+		std::string strArg;
+		float numArg;
+	public:
+		SendEventTask(std::string eventName, std::string strArg, float numArg) : eventName(eventName), strArg(strArg), numArg(numArg) {}
+
+		virtual void Run() {
+			ChangeNotifier::GetInstance().Send(eventName, strArg, numArg);
+		}
+		virtual void Dispose() {
+			delete this;
+		}
+	};
+
+	class IniCache {
+	private:
+		struct ParsedList {
+			std::vector<std::string> strings;
+			std::vector<SInt32> ints;
+			std::vector<float> floats;
+			bool hasInts = false;
+			bool hasFloats = false;
+		};
+
+		std::string path;
+		CSimpleIniA ini;
+		// true, if the cache has changes that were not saved yet
+		std::atomic<bool> modified = false;
+		std::shared_mutex lock;
+		// last write time of the file when it was loaded or saved, used to detect outside changes
+		std::atomic<long long> fileTime = 0;
+		// tick count of the last outside change that was not loaded yet, 0 if there is none
+		std::atomic<ULONGLONG> changedAt = 0;
+		// false for caches loaded by the prefetch, until they are used for the first time
+		std::atomic<bool> used = false;
+		// true, after the cache was replaced by a reloaded cache. Guarded by lock, so writes to it can be redirected to the reloaded cache.
+		bool retired = false;
+		// estimated memory of ini, computed again on the next GetSize after it changed
+		std::atomic<size_t> size = 0;
+		std::atomic<bool> sizeStale = true;
+		// lower case "section::key" -> (delimiter -> parsed list value)
+		// Readers only share the ini lock, so they need listLock. Writers hold the ini lock exclusively and remove the lists of the written keys.
+		std::unordered_map<std::string, std::unordered_map<std::string, ParsedList>> lists;
+		std::mutex listLock;
+		// lower case section -> copy of the section from the last snapshot, removed when the section changes
+		std::unordered_map<std::string, std::shared_ptr<const SectionSnapshot>> sectionSnapshots;
+		// snapshot bound by Bind, copied into ini by the first operation on the contents. Guarded by lock.
+		std::shared_ptr<const IniSnapshot> bound;
+		std::atomic<bool> hasBound = false;
+
+		// Directives are only read by Load, so the following members do not change afterwards and can be read without lock.
+		// true, if the file uses @include or @inherit and reads use the flattened sections
+		bool flatten = false;
+		// paths of the included files in the order of the @include directive
+		std::vector<std::string> includes;
+		// lower case section -> names of the sections in the file, e.g. "Child : Base" and "Child" for "child"
+		std::unordered_map<std::string, std::vector<std::string>> rawSections;
+		// lower case section -> lower case base section
+		std::unordered_map<std::string, std::string> bases;
+		// lower case base section -> lower case sections inheriting directly from it
+		std::unordered_map<std::string, std::vector<std::string>> children;
+
+		// lower case section -> flattened section, resolved on first read
+		std::unordered_map<std::string, std::shared_ptr<const FlatSection>> flatSections;
+		std::mutex flatLock;
+		// sections changed since the flattened sections were last used, collected separately, so writers never wait for flatLock
+		std::unordered_set<std::string> staleSections;
+		bool allStale = false;
+		std::atomic<UInt32> flatGeneration = 0;
+		std::mutex staleLock;
+
+		// true, if the file uses @interpolate and ${key:section} references in values are replaced when reading
+		bool interpolate = false;
+		// lower case "section::key" -> value after replacing its references, resolved on first read
+		std::unordered_map<std::string, std::string> interpolated;
+		// lower case "section::key" -> lower case "section::key" of the settings referenced by its value
+		std::unordered_map<std::string, std::vector<std::string>> references;
+		// lower case "section::key" -> lower case "section::key" of the settings whose values reference it
+		std::unordered_map<std::string, std::unordered_set<std::string>> referencedBy;
+		// increased whenever interpolated values are removed, so results resolved in the meantime are not kept
+		UInt32 interpolateGeneration = 0;
+		std::mutex interpolateLock;
+
+		/// <summary>
+		/// Reads the @include and @inherit directives from the keys before the first section.
+		/// </summary>
+		void LoadDirectives() {
+			IncludeGraph::GetInstance().RemoveIncludes(path);
+			auto include = ini.GetValue("", "@include", nullptr);
+			if (include != nullptr) {
+				for (auto& element : SplitList(include, LIST_DELIMITER)) {
+					auto includePath = CanonicalPaths::GetInstance().Get(element);
+					if (IncludeGraph::GetInstance().Add(path, includePath)) {
+						includes.push_back(includePath);
+					}
+					else {
+						Logger::Error("Include cycle: " + path + " cannot include " + includePath);
+					}
+				}
+			}
+			interpolate = ini.GetBoolValue("", "@interpolate", false);
+			bool inherit = ini.GetBoolValue("", "@inherit", false);
+			flatten = !includes.empty() || inherit;
+			if (inherit) {
+				LoadInheritance();
+			}
+			if (interpolate) {
+				std::lock_guard<std::mutex> guard(interpolateLock);
+				LoadReferences();
+				DetectReferenceCycles();
+			}
+		}
+
+		/// <summary>
+		/// Reads the base sections of [Child : Base] sections.
+		/// </summary>
+		void LoadInheritance() {
+			CSimpleIniA::TNamesDepend sections;
+			ini.GetAllSections(sections);
+			sections.sort(CSimpleIniA::Entry::LoadOrder());
+			for (auto& section : sections) {
+				std::string name = section.pItem;
+				auto colonIndex = name.find(':');
+				if (colonIndex == std::string::npos) {
+					rawSections[ToLower(name)].push_back(name);
+					continue;
+				}
+				auto child = ToLower(Trim(name.substr(0, colonIndex)));
+				auto base = ToLower(Trim(name.substr(colonIndex + 1)));
+				// sections with a colon are written first, so writes to the child go to the section declaring the base
+				auto& raw = rawSections[child];
+				raw.insert(raw.begin(), name);
+				if (base.compare("") != 0 && bases.find(child) == bases.end()) {
+					bases[child] = base;
+				}
+			}
+			// remove bases that would create a cycle
+			for (auto& it : rawSections) {
+				std::unordered_set<std::string> chain{ it.first };
+				auto current = it.first;
+				while (bases.find(current) != bases.end()) {
+					auto& base = bases[current];
+					if (!chain.insert(base).second) {
+						Logger::Error("Inheritance cycle: section [" + current + "] cannot inherit from [" + base + "] in file " + path);
+						bases.erase(current);
+						break;
+					}
+					current = base;
+				}
+			}
+			for (auto& it : bases) {
+				children[it.second].push_back(it.first);
+			}
+		}
+
+		/// <summary>
+		/// Replaces the references of a value in the reference graph. Must be called with interpolateLock held.
+		/// </summary>
+		void SetReferences(const std::string& section, const std::string& key, const std::string& value) {
+			auto id = ToLower(section + SECTION_KEY_SEP + key);
+			auto old = references.find(id);
+			if (old != references.end()) {
+				for (auto& reference : old->second) {
+					referencedBy[reference].erase(id);
+				}
+				references.erase(old);
+			}
+			for (auto& reference : FindReferences(value, section)) {
+				auto referenceId = ToLower(reference.first + SECTION_KEY_SEP + reference.second);
+				references[id].push_back(referenceId);
+				referencedBy[referenceId].insert(id);
+			}
+		}
+
+		/// <summary>
+		/// Builds the reference graph from all values and removes all interpolated values. Must be called with interpolateLock held.
+		/// </summary>
+		void LoadReferences() {
+			interpolated.clear();
+			references.clear();
+			referencedBy.clear();
+			interpolateGeneration++;
+			CSimpleIniA::TNamesDepend sections;
+			ini.GetAllSections(sections);
+			for (auto& section : sections) {
+				// inherited sections are read by the name of the child
+				std::string name = section.pItem;
+				if (!rawSections.empty()) {
+					name = Trim(name.substr(0, name.find(':')));
+				}
+				for (auto& it : *ini.GetSection(section.pItem)) {
+					SetReferences(name, it.first.pItem, it.second);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Logs all reference cycles. Values in a cycle keep their references to the setting closing the cycle when they are read.
+		/// Must be called with interpolateLock held.
+		/// </summary>
+		void DetectReferenceCycles() {
+			// 1: being visited, 2: visited
+			std::unordered_map<std::string, int> state;
+			std::function<void(const std::string&)> visit = [&](const std::string& id) {
+				state[id] = 1;
+				auto it = references.find(id);
+				if (it != references.end()) {
+					for (auto& reference : it->second) {
+						auto referenceState = state.find(reference);
+						if (referenceState == state.end()) {
+							visit(reference);
+						}
+						else if (referenceState->second == 1) {
+							Logger::Error("Interpolation cycle in file " + path + ": " + id + " references " + reference);
+						}
+					}
+				}
+				state[id] = 2;
+			};
+			for (auto& it : references) {
+				if (state.find(it.first) == state.end()) {
+					visit(it.first);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Removes the interpolated values of a changed setting and of all values referencing it, then updates its references.
+		/// </summary>
+		void ChangeReferences(const std::string& section, const std::string& key, const std::string& value) {
+			std::lock_guard<std::mutex> guard(interpolateLock);
+			interpolateGeneration++;
+			std::vector<std::string> changed{ ToLower(section + SECTION_KEY_SEP + key) };
+			std::unordered_set<std::string> visited{ changed.front() };
+			for (size_t i = 0; i < changed.size(); i++) {
+				interpolated.erase(changed[i]);
+				auto it = referencedBy.find(changed[i]);
+				if (it != referencedBy.end()) {
+					for (auto& id : it->second) {
+						if (visited.insert(id).second) {
+							changed.push_back(id);
+						}
+					}
+				}
+			}
+			SetReferences(section, key, value);
+		}
+
+		/// <summary>
+		/// Replaces the ${key:section} references of a value with the interpolated values of the referenced settings.
+		/// Missing settings are replaced with "". chain contains the settings currently being interpolated and is used to stop at cycles.
+		/// Must be called without holding the lock of the cache.
+		/// </summary>
+		std::string Interpolate(const std::string& section, const std::string& key, const std::string& value, std::vector<std::string>& chain) {
+			if (value.find("${") == std::string::npos) {
+				return value;
+			}
+			auto id = ToLower(section + SECTION_KEY_SEP + key);
+			if (std::find(chain.begin(), chain.end(), id) != chain.end()) {
+				return value;
+			}
+			UInt32 generation;
+			{
+				std::lock_guard<std::mutex> guard(interpolateLock);
+				auto it = interpolated.find(id);
+				if (it != interpolated.end()) {
+					return it->second;
+				}
+				generation = interpolateGeneration;
+			}
+			chain.push_back(id);
+			std::string result;
+			size_t pos = 0;
+			for (auto& reference : FindReferences(value, section)) {
+				auto begin = value.find("${", pos);
+				auto end = value.find('}', begin);
+				result.append(value, pos, begin - pos);
+				std::string referenceValue;
+				if (ReadRaw(reference.first, reference.second, referenceValue)) {
+					result += Interpolate(reference.first, reference.second, referenceValue, chain);
+				}
+				pos = end + 1;
+			}
+			result.append(value, pos, std::string::npos);
+			chain.pop_back();
+			std::lock_guard<std::mutex> guard(interpolateLock);
+			// only keep the result, if nothing changed while it was resolved
+			if (generation == interpolateGeneration) {
+				interpolated[id] = result;
+			}
+			return result;
+		}
+
+		/// <summary>
+		/// Returns the keys of a section declared in the file itself. Inherited sections can be declared as [Child : Base] and [Child],
+		/// so their keys are merged into merged, with the keys of later sections first, since they override the keys of the section declaring the base.
+		/// The lock has to be held, while the result is used.
+		/// </summary>
+		const CSimpleIniA::TKeyVal* GetKeyValues(const std::string& section, CSimpleIniA::TKeyVal& merged) {
+			auto it = rawSections.find(ToLower(section));
+			if (it == rawSections.end()) {
+				return ini.GetSection(section.c_str());
+			}
+			if (it->second.size() == 1) {
+				return ini.GetSection(it->second.front().c_str());
+			}
+			for (auto name = it->second.rbegin(); name != it->second.rend(); name++) {
+				auto keyValues = ini.GetSection(name->c_str());
+				if (keyValues != nullptr) {
+					merged.insert(keyValues->begin(), keyValues->end());
+				}
+			}
+			return &merged;
+		}
+
+		/// <summary>
+		/// Returns the name of the section in the file, which is "Child : Base" for inherited sections.
+		/// </summary>
+		const std::string& RawSection(const std::string& section) {
+			if (rawSections.empty()) {
+				return section;
+			}
+			auto it = rawSections.find(ToLower(section));
+			return it != rawSections.end() ? it->second.front() : section;
+		}
+
+		/// <summary>
+		/// Removes the flattened sections that were changed. Must be called with flatLock held.
+		/// </summary>
+		void RemoveStaleSections() {
+			std::lock_guard<std::mutex> guard(staleLock);
+			if (allStale) {
+				flatSections.clear();
+			}
+			else {
+				for (auto& section : staleSections) {
+					flatSections.erase(section);
+				}
+			}
+			staleSections.clear();
+			allStale = false;
+		}
+
+		/// <summary>
+		/// Returns the parsed list value of a setting, parsing it on first use. Must be called with both locks held.
+		/// </summary>
+		ParsedList& GetList(std::string& section, std::string& key, std::string& delimiter) {
+			auto& keyLists = lists[ToLower(section + SECTION_KEY_SEP + key)];
+			auto it = keyLists.find(delimiter);
+			if (it != keyLists.end()) {
+				return it->second;
+			}
+			auto& list = keyLists[delimiter];
+			list.strings = SplitList(ini.GetValue(section.c_str(), key.c_str(), ""), delimiter);
+			return list;
+		}
+
+		/// <summary>
+		/// Removes the parsed list values of a written setting. Must be called with the lock held exclusively.
+		/// </summary>
+		void EraseLists(const std::string& section, const std::string& key) {
+			lists.erase(ToLower(section + SECTION_KEY_SEP + key));
+		}
+
+		/// <summary>
+		/// Removes the parsed list values of all keys of a written section. Must be called with the lock held exclusively.
+		/// </summary>
+		void EraseSectionLists(const std::string& section) {
+			auto prefix = ToLower(section + SECTION_KEY_SEP);
+			for (auto it = lists.begin(); it != lists.end();) {
+				if (it->first.compare(0, prefix.size(), prefix) == 0) {
+					it = lists.erase(it);
+				}
+				else {
+					++it;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Replaces all sections of ini with the sections of a snapshot. Must be called while holding the lock exclusively.
+		/// </summary>
+		void RestoreEntries(const IniSnapshot& snapshot) {
+			CSimpleIniA::TNamesDepend sections;
+			ini.GetAllSections(sections);
+			for (auto& section : sections) {
+				// copy the name, because deleting the section frees it
+				std::string name = section.pItem;
+				ini.Delete(name.c_str(), nullptr);
+			}
+			modified = true;
+			sizeStale = true;
+			lists.clear();
+			sectionSnapshots.clear();
+			for (auto& section : snapshot.sections) {
+				ini.SetValue(section->section.c_str(), nullptr, nullptr, section->comment.empty() ? nullptr : section->comment.c_str());
+				for (auto& entry : section->entries) {
+					ini.SetValue(section->section.c_str(), entry.key.c_str(), entry.value.c_str(), entry.comment.empty() ? nullptr : entry.comment.c_str());
+				}
+				// the restored section is identical to the snapshot, so the next snapshot can share it
+				sectionSnapshots[ToLower(section->section)] = section;
+			}
+			KeyIndex::GetInstance().IndexFile(path, ini);
+			if (interpolate) {
+				std::lock_guard<std::mutex> interpolateGuard(interpolateLock);
+				LoadReferences();
+			}
+		}
+
+		/// <summary>
+		/// Copies the snapshot bound by Bind into ini. Called by every operation on the contents, so the copy happens only once they are used.
+		/// </summary>
+		void CopyBound() {
+			if (!hasBound) {
+				return;
+			}
+			std::unique_lock<std::shared_mutex> guard(lock);
+			if (bound == nullptr) {
+				return;
+			}
+			auto snapshot = std::move(bound);
+			bound = nullptr;
+			hasBound = false;
+			Logger::DebugMsg("Copy Bound Snapshot: {" + path + "} <- {" + snapshot->path + "} " + std::to_string(snapshot->sections.size()) + " sections");
+			RestoreEntries(*snapshot);
+		}
+	public:
+		IniCache() = delete;
+		IniCache(const IniCache&) = delete;
+		IniCache(IniCache&&) = delete;
+		IniCache& operator=(IniCache&&) = delete;
+		IniCache& operator=(IniCache&) = delete;
+
+		IniCache(std::string path) {
+			this->path = path;
+			Load();
+		}
+
+		void Load() {
+			Logger::Msg("Load Cache: {" + path + "}");
+			fileTime = FileHelper::GetWriteTime(path);
+			SI_Error rc = ini.LoadFile(path.c_str());
+			if (rc < 0) {
+				FileHelper::FileCannotBeLoaded(path);
+				return;
+			}
+			LoadDirectives();
+			KeyIndex::GetInstance().IndexFile(path, ini);
+		}
+
+		/// <summary>
+		/// Returns the estimated memory of the cache in bytes. See EstimateIniSize.
+		/// </summary>
+		size_t GetSize() {
+			if (sizeStale) {
+				std::shared_lock<std::shared_mutex> guard(lock);
+				size = EstimateIniSize(ini);
+				sizeStale = false;
+			}
+			return size;
+		}
+
+		/// <summary>
+		/// Returns the values of a section after resolving inheritance and includes.
+		/// Values of the base section are overridden by values of included files, which are overridden by values of the section itself.
+		/// Must be called without holding any lock of the cache, since included files may have to be loaded.
+		/// </summary>
+		std::shared_ptr<const FlatSection> GetFlatSection(const std::string& lowerSection);
+
+		/// <summary>
+		/// Marks the flattened sections as changed, including the sections inheriting from them and the sections of files including this file.
+		/// Must be called without holding the lock of the cache.
+		/// </summary>
+		void Invalidate(std::vector<std::string> lowerSections);
+		void InvalidateAll();
+
+		/// <summary>
+		/// Returns the cache that replaced this cache, after it was retired.
+		/// </summary>
+		std::shared_ptr<IniCache> Current();
+
+		/// <summary>
+		/// Removes all interpolated values of a flattened file, since changes of base sections and included files are not tracked per value.
+		/// </summary>
+		void ClearInterpolated() {
+			if (!interpolate || !flatten) {
+				return;
+			}
+			std::lock_guard<std::mutex> guard(interpolateLock);
+			interpolated.clear();
+			interpolateGeneration++;
+		}
+
+		/// <summary>
+		/// Adds all keys of the cache to the KeyIndex.
+		/// </summary>
+		void Index() {
+			CopyBound();
+			std::shared_lock<std::shared_mutex> guard(lock);
+			KeyIndex::GetInstance().IndexFile(path, ini);
+		}
+
+		/// <summary>
+		/// Reads a value without interpolation. Returns false, if it does not exist.
+		/// </summary>
+		bool ReadRaw(const std::string& section, const std::string& key, std::string& value) {
+			CopyBound();
+			if (flatten) {
+				auto flat = GetFlatSection(ToLower(section));
+				auto it = flat->values.find(ToLower(key));
+				if (it == flat->values.end()) {
+					return false;
+				}
+				value = it->second;
+				return true;
+			}
+			std::shared_lock<std::shared_mutex> guard(lock);
+			auto rawValue = ini.GetValue(section.c_str(), key.c_str(), nullptr);
+			if (rawValue == nullptr) {
+				return false;
+			}
+			value = rawValue;
+			return true;
+		}
+
+		std::string Read(std::string section, std::string key, std::string& def) {
+			std::string value;
+			if (!ReadRaw(section, key, value)) {
+				value = def;
+			}
+			else if (interpolate) {
+				std::vector<std::string> chain;
+				value = Interpolate(section, key, value, chain);
+			}
+			Logger::DebugMsg("Read Cache: " + IniAccess(path, section, key) + " value=" + value);
+			return value;
+		}
+
+		/// <summary>
+		/// Reads multiple values while holding the lock only once.
+		/// </summary>
+		void Read(std::vector<std::pair<std::string, std::string>>& settings, std::vector<std::string>& values, std::vector<bool>& found) {
+			CopyBound();
+			if (flatten || interpolate) {
+				for (size_t i = 0; i < settings.size(); i++) {
+					if (settings[i].first.compare("") == 0 || settings[i].second.compare("") == 0) {
+						continue;
+					}
+					if (ReadRaw(settings[i].first, settings[i].second, values[i])) {
+						found[i] = true;
+						if (interpolate) {
+							std::vector<std::string> chain;
+							values[i] = Interpolate(settings[i].first, settings[i].second, values[i], chain);
+						}
+					}
+				}
+				return;
+			}
+			std::shared_lock<std::shared_mutex> guard(lock);
+			Logger::DebugMsg("Read Cache: {" + path + "} " + std::to_string(settings.size()) + " values");
+			ReadValues(ini, settings, values, found);
+		}
+
+		/// <summary>
+		/// Reads a page of the keys and values of a section. See ReadSectionEntries.
+		/// </summary>
+		void ReadSection(std::string& section, SInt32 start, SInt32 count, std::vector<std::string>* keys, std::vector<std::string>* values) {
+			CopyBound();
+			std::shared_lock<std::shared_mutex> guard(lock);
+			Logger::DebugMsg("Read Cache Section: {" + path + "}[" + section + "] start=" + std::to_string(start) + " count=" + std::to_string(count));
+			CSimpleIniA::TKeyVal merged;
+			ReadSectionEntries(GetKeyValues(section, merged), start, count, keys, values);
+		}
+
+		/// <summary>
+		/// Finds keys of a section. See FindSectionKeys.
+		/// </summary>
+		std::vector<std::string> FindKeys(std::string& section, std::string& prefix, std::string& pattern) {
+			CopyBound();
+			std::shared_lock<std::shared_mutex> guard(lock);
+			std::vector<std::string> keys;
+			CSimpleIniA::TKeyVal merged;
+			FindSectionKeys(GetKeyValues(section, merged), prefix, pattern, keys);
+			Logger::DebugMsg("Find Cache Keys: {" + path + "}[" + section + "] prefix=" + prefix + " pattern=" + pattern + " -> " + std::to_string(keys.size()) + " keys");
+			return keys;
+		}
+
+		SInt32 GetSectionSize(std::string& section) {
+			CopyBound();
+			std::shared_lock<std::shared_mutex> guard(lock);
+			CSimpleIniA::TKeyVal merged;
+			return CountSectionKeys(GetKeyValues(section, merged));
+		}
+
+		std::vector<std::string> ReadStringList(std::string& section, std::string& key, std::string& delimiter) {
+			CopyBound();
+			if (flatten || interpolate) {
+				return SplitList(Read(section, key, std::string("")), delimiter);
+			}
+			std::shared_lock<std::shared_mutex> guard(lock);
+			std::lock_guard<std::mutex> listGuard(listLock);
+			return GetList(section, key, delimiter).strings;
+		}
+
+		std::vector<SInt32> ReadIntList(std::string& section, std::string& key, std::string& delimiter) {
+			CopyBound();
+			if (flatten || interpolate) {
+				return ToIntList(ReadStringList(section, key, delimiter));
+			}
+			std::shared_lock<std::shared_mutex> guard(lock);
+			std::lock_guard<std::mutex> listGuard(listLock);
+			auto& list = GetList(section, key, delimiter);
+			if (!list.hasInts) {
+				list.ints = ToIntList(list.strings);
+				list.hasInts = true;
+			}
+			return list.ints;
+		}
+
+		std::vector<float> ReadFloatList(std::string& section, std::string& key, std::string& delimiter) {
+			CopyBound();
+			if (flatten || interpolate) {
+				return ToFloatList(ReadStringList(section, key, delimiter));
+			}
+			std::shared_lock<std::shared_mutex> guard(lock);
+			std::lock_guard<std::mutex> listGuard(listLock);
+			auto& list = GetList(section, key, delimiter);
+			if (!list.hasFloats) {
+				list.floats = ToFloatList(list.strings);
+				list.hasFloats = true;
+			}
+			return list.floats;
+		}
+
+		void Write(std::string& section, std::string& key, std::string& value) {
+			CopyBound();
+			Logger::DebugMsg("Write Cache: " + IniAccess(path, section, key) + " value=" + value);
+			std::unique_lock<std::shared_mutex> guard(lock);
+			if (retired) {
+				guard.unlock();
+				Current()->Write(section, key, value);
+				return;
+			}
+			auto raw = RawSection(section);
+			modified = true;
+			sizeStale = true;
+			EraseLists(section, key);
+			sectionSnapshots.erase(ToLower(raw));
+			SI_Error rc = ini.SetValue(raw.c_str(), key.c_str(), value.c_str());
+			if (rc < 0) {
+				Logger::Error("Failed to write buffer: " + path);
+				Logger::Error("\tThis is an error with PapyrusIni.Please report the bug.");
+				return;
+			}
+			KeyIndex::GetInstance().Add(path, section, key);
+			if (interpolate) {
+				ChangeReferences(section, key, value);
+			}
+			guard.unlock();
+			Invalidate({ ToLower(section) });
+		}
+
+		/// <summary>
+		/// Reads a value, computes the new value and writes it without releasing the lock in between.
+		/// update receives the old value or nullptr, if it does not exist, and returns true, if the new value should be written.
+		/// Sets value to the value after the update and returns true, if it was written.
+		/// </summary>
+		bool Update(std::string& section, std::string& key, std::function<bool(const char*, std::string&)>& update, std::string& value) {
+			CopyBound();
+			// the flattened value is read before taking the lock, so flattened updates are only atomic with respect to the file itself
+			std::string flatValue;
+			bool hasFlatValue = false;
+			if (flatten) {
+				auto flat = GetFlatSection(ToLower(section));
+				auto it = flat->values.find(ToLower(key));
+				if (it != flat->values.end()) {
+					flatValue = it->second;
+					hasFlatValue = true;
+				}
+			}
+			std::unique_lock<std::shared_mutex> guard(lock);
+			if (retired) {
+				guard.unlock();
+				return Current()->Update(section, key, update, value);
+			}
+			auto raw = RawSection(section);
+			auto oldValue = ini.GetValue(raw.c_str(), key.c_str(), nullptr);
+			if (oldValue == nullptr && hasFlatValue) {
+				oldValue = flatValue.c_str();
+			}
+			if (!update(oldValue, value)) {
+				value = oldValue != nullptr ? oldValue : "";
+				return false;
+			}
+			Logger::DebugMsg("Update Cache: " + IniAccess(path, section, key) + " value=" + value);
+			modified = true;
+			sizeStale = true;
+			EraseLists(section, key);
+			sectionSnapshots.erase(ToLower(raw));
+			SI_Error rc = ini.SetValue(raw.c_str(), key.c_str(), value.c_str());
+			if (rc < 0) {
+				Logger::Error("Failed to write buffer: " + path);
+				Logger::Error("\tThis is an error with PapyrusIni.Please report the bug.");
+				return false;
+			}
+			KeyIndex::GetInstance().Add(path, section, key);
+			if (interpolate) {
+				ChangeReferences(section, key, value);
+			}
+			guard.unlock();
+			Invalidate({ ToLower(section) });
+			return true;
+		}
+
+		/// <summary>
+		/// Writes multiple values while holding the lock only once.
+		/// </summary>
+		void Write(std::vector<std::pair<std::string, std::string>>& settings, std::vector<std::string>& values) {
+			CopyBound();
+			Logger::DebugMsg("Write Cache: {" + path + "} " + std::to_string(settings.size()) + " values");
+			std::unique_lock<std::shared_mutex> guard(lock);
+			if (retired) {
+				guard.unlock();
+				Current()->Write(settings, values);
+				return;
+			}
+			modified = true;
+			sizeStale = true;
+			std::vector<std::string> changedSections;
+			for (size_t i = 0; i < settings.size(); i++) {
+				EraseLists(settings[i].first, settings[i].second);
+				auto raw = RawSection(settings[i].first);
+				sectionSnapshots.erase(ToLower(raw));
+				changedSections.push_back(ToLower(settings[i].first));
+				SI_Error rc = ini.SetValue(raw.c_str(), settings[i].second.c_str(), values[i].c_str());
+				if (rc < 0) {
+					Logger::Error("Failed to write buffer: " + path);
+					Logger::Error("\tThis is an error with PapyrusIni.Please report the bug.");
+					break;
+				}
+				KeyIndex::GetInstance().Add(path, settings[i].first, settings[i].second);
+				if (interpolate) {
+					ChangeReferences(settings[i].first, settings[i].second, values[i]);
+				}
+			}
+			guard.unlock();
+			Invalidate(changedSections);
+		}
+
+		/// <summary>
+		/// Writes a whole section at once. See WriteSectionEntries.
+		/// </summary>
+		void WriteSection(std::string& section, std::vector<std::string>& keys, std::vector<std::string>& values, bool replace) {
+			CopyBound();
+			Logger::DebugMsg("Write Cache Section: {" + path + "}[" + section + "] " + std::to_string(keys.size()) + " values");
+			std::unique_lock<std::shared_mutex> guard(lock);
+			if (retired) {
+				guard.unlock();
+				Current()->WriteSection(section, keys, values, replace);
+				return;
+			}
+			auto raw = RawSection(section);
+			if (WriteSectionEntries(ini, raw, keys, values, replace)) {
+				modified = true;
+				sizeStale = true;
+				EraseSectionLists(section);
+				sectionSnapshots.erase(ToLower(raw));
+				KeyIndex::GetInstance().IndexFile(path, ini);
+				if (interpolate) {
+					std::lock_guard<std::mutex> interpolateGuard(interpolateLock);
+					LoadReferences();
+				}
+				guard.unlock();
+				Invalidate({ ToLower(section) });
+			}
+		}
+
+		/// <summary>
+		/// Copies the current state of the cache. Sections that did not change since the last snapshot are shared with it instead of copied.
+		/// </summary>
+		std::shared_ptr<const IniSnapshot> Snapshot() {
+			CopyBound();
+			std::unique_lock<std::shared_mutex> guard(lock);
+			auto snapshot = std::make_shared<IniSnapshot>();
+			snapshot->path = path;
+			CSimpleIniA::TNamesDepend sections;
+			ini.GetAllSections(sections);
+			sections.sort(CSimpleIniA::Entry::LoadOrder());
+			size_t copied = 0;
+			for (auto& section : sections) {
+				auto& shared = sectionSnapshots[ToLower(section.pItem)];
+				if (shared == nullptr) {
+					shared = CopySectionEntries(ini, section);
+					copied++;
+				}
+				snapshot->sections.push_back(shared);
+			}
+			Logger::DebugMsg("Snapshot Cache: {" + path + "} " + std::to_string(sections.size()) + " sections, " + std::to_string(copied) + " copied");
+			return snapshot;
+		}
+
+		/// <summary>
+		/// Replaces all sections of the cache with the sections of a snapshot. The file is changed the next time the cache is saved.
+		/// </summary>
+		void Restore(const IniSnapshot& snapshot) {
+			Logger::DebugMsg("Restore Cache: {" + path + "} " + std::to_string(snapshot.sections.size()) + " sections");
+			std::unique_lock<std::shared_mutex> guard(lock);
+			if (retired) {
+				guard.unlock();
+				Current()->Restore(snapshot);
+				return;
+			}
+			// the restored contents replace a bound snapshot, so it is never copied
+			bound = nullptr;
+			hasBound = false;
+			RestoreEntries(snapshot);
+			guard.unlock();
+			InvalidateAll();
+		}
+
+		/// <summary>
+		/// Replaces all sections of the cache with the sections of a snapshot, like Restore, but without copying them.
+		/// The snapshot is copied by the first operation on the contents of the cache, so binding several snapshots in a row only copies the last one.
+		/// </summary>
+		void Bind(std::shared_ptr<const IniSnapshot> snapshot) {
+			Logger::DebugMsg("Bind Cache: {" + path + "} <- {" + snapshot->path + "}");
+			std::unique_lock<std::shared_mutex> guard(lock);
+			if (retired) {
+				guard.unlock();
+				Current()->Bind(snapshot);
+				return;
+			}
+			bound = snapshot;
+			hasBound = true;
+			// the bound snapshot is an unsaved change, so the cache is not loaded again and the snapshot is not lost
+			modified = true;
+			guard.unlock();
+			InvalidateAll();
+		}
+
+		/// <summary>
+		/// Adds the sections of a snapshot of another file to the cache. See MergeSectionEntries.
+		/// </summary>
+		void Merge(const IniSnapshot& snapshot, bool overwrite) {
+			CopyBound();
+			Logger::DebugMsg("Merge Cache: {" + path + "} <- {" + snapshot.path + "} " + std::to_string(snapshot.sections.size()) + " sections");
+			std::unique_lock<std::shared_mutex> guard(lock);
+			if (retired) {
+				guard.unlock();
+				Current()->Merge(snapshot, overwrite);
+				return;
+			}
+			if (MergeSectionEntries(ini, snapshot, overwrite)) {
+				modified = true;
+				sizeStale = true;
+				for (auto& section : snapshot.sections) {
+					EraseSectionLists(section->section);
+					sectionSnapshots.erase(ToLower(section->section));
+				}
+				KeyIndex::GetInstance().IndexFile(path, ini);
+				if (interpolate) {
+					std::lock_guard<std::mutex> interpolateGuard(interpolateLock);
+					LoadReferences();
+				}
+				guard.unlock();
+				InvalidateAll();
+			}
+		}
+
+		/// <summary>
+		/// Called by the FileWatcher, when the directory of the file changed. Remembers the change, if the file itself changed.
+		/// </summary>
+		void FileChanged() {
+			if (FileHelper::GetWriteTime(path) != fileTime) {
+				changedAt = GetTickCount64();
+			}
+		}
+
+		/// <summary>
+		/// Remembers the current write time of the file after it was written without the cache, so the write is not seen as an outside change.
+		/// </summary>
+		void FileWritten() {
+			fileTime = FileHelper::GetWriteTime(path);
+		}
+
+		bool IsUsed() {
+			return used;
+		}
+
+		bool IsModified() {
+			return modified;
+		}
+
+		/// <summary>
+		/// Marks the cache as used and returns true, if it was not used before.
+		/// </summary>
+		bool MarkUsed() {
+			return !used.exchange(true);
+		}
+
+		/// <summary>
+		/// Returns true, if the cache was loaded by the prefetch and the file changed before its first use, so it should be loaded again.
+		/// </summary>
+		bool IsPrefetchOutdated() {
+			return !used && FileHelper::GetWriteTime(path) != fileTime;
+		}
+
+		/// <summary>
+		/// Returns true, if an outside change was remembered and was not loaded yet.
+		/// </summary>
+		bool IsReloadPending() {
+			return changedAt != 0;
+		}
+
+		/// <summary>
+		/// Returns true, if an outside change was remembered and no further changes happened for RELOAD_DELAY_MS.
+		/// </summary>
+		bool IsReloadDue() {
+			ULONGLONG changed = changedAt;
+			return changed != 0 && GetTickCount64() - changed >= RELOAD_DELAY_MS;
+		}
+
+		/// <summary>
+		/// Returns true, if the cache may have to be loaded again. Does not wait for the lock, see Retire.
+		/// </summary>
+		bool MayNeedReload() {
+			return IsPrefetchOutdated() || IsReloadDue();
+		}
+
+		/// <summary>
+		/// Retires the cache and returns true, if it should be loaded again or force is true. The check holds the lock,
+		/// so no write can happen between the check for unsaved changes and retiring. Later writes are redirected to the reloaded cache.
+		/// </summary>
+		bool Retire(bool force) {
+			// most calls find nothing to reload, so they do not wait for readers of the cache
+			if (!force && !MayNeedReload()) {
+				return false;
+			}
+			std::unique_lock<std::shared_mutex> guard(lock);
+			if (!force && !IsPrefetchOutdated() && !NeedsReload()) {
+				return false;
+			}
+			retired = true;
+			return true;
+		}
+
+		/// <summary>
+		/// Returns true, if the file changed outside and no further changes happened for RELOAD_DELAY_MS, so it should be loaded again.
+		/// Caches with unsaved changes are not loaded again, since that would discard the changes.
+		/// </summary>
+		bool NeedsReload() {
+			if (!IsReloadDue()) {
+				return false;
+			}
+			changedAt = 0;
+			if (FileHelper::GetWriteTime(path) == fileTime) {
+				return false;
+			}
+			if (modified) {
+				Logger::Msg("File changed outside: {" + path + "} -> keep buffer with unsaved changes");
+				return false;
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// Writes the changes to the file. Returns false, if the file cannot be saved, so the changes are still unsaved.
+		/// </summary>
+		bool Save() {
+			CopyBound();
+			std::shared_lock<std::shared_mutex> guard(lock);
+			if (modified.exchange(false)) {
+				Logger::Msg("Save Cache: {" + path + "} -> save");
+				FileHelper::CreateParentDir(path);
+				SI_Error rc = ini.SaveFile(path.c_str());
+				if (rc < 0) {
+					modified = true;
+					FileHelper::FileCannotBeSaved(path);
+					return false;
+				}
+				fileTime = FileHelper::GetWriteTime(path);
+				ReadCache::GetInstance().Invalidate(path);
+			}
+			else {
+				Logger::Msg("Save Cache: {" + path + "} -> no changes");
+			}
+			return true;
+		}
+	};
+
+
+	/// <summary>
+	/// Writes multiple values to a file with a single load and save.
+	/// If overwrite is false, values that already exist in the file are not changed.
+	/// Duplicate keys are kept and only the first of them is replaced, like WritePrivateProfileStringA does, so all other entries stay untouched.
+	/// </summary>
+	void WriteValues(std::string& path, std::vector<std::pair<std::string, std::string>>& settings, std::vector<std::string>& values, bool overwrite) {
+		ReadCache::GetInstance().Invalidate(path);
+		CSimpleIniA ini;
+		ini.SetMultiKey(true);
+		SI_Error rc = ini.LoadFile(path.c_str());
+		if (rc < 0 && std::filesystem::exists(path)) {
+			// the file exists, but cannot be parsed, so do not replace it and write the values individually
+			for (size_t i = 0; i < settings.size(); i++) {
+				auto& section = settings[i].first;
+				auto& key = settings[i].second;
+				if (!overwrite) {
+					char value[2];
+					if (GetPrivateProfileStringA(section.c_str(), key.c_str(), "", value, sizeof(value), path.c_str()) > 0) {
+						continue;
+					}
+				}
+				if (!WritePrivateProfileStringA(section.c_str(), key.c_str(), values[i].c_str(), path.c_str())) {
+					Logger::Msg("Failed to write file: " + path);
+					Logger::Msg("	 Check that the path is correct and the file is not protected or read-only.");
+					return;
+				}
+				KeyIndex::GetInstance().Add(path, section, key);
+			}
+			return;
+		}
+
+		bool modified = false;
+		for (size_t i = 0; i < settings.size(); i++) {
+			auto& section = settings[i].first;
+			auto& key = settings[i].second;
+			if (overwrite || ini.GetValue(section.c_str(), key.c_str(), nullptr) == nullptr) {
+				ini.SetValue(section.c_str(), key.c_str(), values[i].c_str(), nullptr, true);
+				modified = true;
+			}
+		}
+		if (modified) {
+			FileHelper::CreateParentDir(path);
+			rc = ini.SaveFile(path.c_str());
+			if (rc < 0) {
+				FileHelper::FileCannotBeSaved(path);
+				return;
+			}
+			KeyIndex::GetInstance().IndexFile(path, ini);
+		}
+	}
+
+	/// <summary>
+	/// Collects the default values written by non-buffered ReadEx functions.
+	/// Instead of rewriting the file once per missing value, all pending values of a file are written together at the end of the frame.
+	/// </summary>
+	class PendingDefaults {
+	private:
+		struct Entry {
+			std::string section;
+			std::string key;
+			std::string value;
+		};
+
+		std::mutex lock;
+		// path -> (lower case "section::key" -> entry)
+		std::unordered_map<std::string, std::unordered_map<std::string, Entry>> pending;
+		bool flushScheduled = false;
+
+		static std::string EntryId(std::string& section, std::string& key) {
+			return ToLower(section + SECTION_KEY_SEP + key);
+		}
+
+		class FlushTask : public TaskDelegate {
+		public:
+			virtual void Run() {
+				PendingDefaults::GetInstance().FlushAll();
+			}
+			virtual void Dispose() {
+				delete this;
+			}
+		};
+
+		/// <summary>
+		/// Writes all pending values of a file and returns their settings. Must be called with the lock held.
+		/// Existing values are overwritten like the write of the default value did before it was batched, since ReadEx only adds a default value,
+		/// if the file has no value of the correct type. Explicit writes in the meantime discard the pending value, see Discard.
+		/// </summary>
+		std::vector<std::pair<std::string, std::string>> WriteFile(std::string path, std::unordered_map<std::string, Entry>& entries) {
+			Logger::DebugMsg("FlushDefaults: {" + path + "} -> " + std::to_string(entries.size()) + " values");
+			std::vector<std::pair<std::string, std::string>> settings;
+			std::vector<std::string> values;
+			for (auto& it : entries) {
+				settings.push_back(std::make_pair(it.second.section, it.second.key));
+				values.push_back(it.second.value);
+			}
+			WriteValues(path, settings, values, true);
+			return settings;
+		}
+
+		/// <summary>
+		/// Tells the IniHandler about the written values. Must be called without holding the lock, since the IniHandler flushes while holding its own lock.
+		/// </summary>
+		void FileWritten(const std::string& path, const std::vector<std::pair<std::string, std::string>>& settings);
+	public:
+		static auto GetInstance() -> PendingDefaults&
+		{
+			static PendingDefaults instance;
+			return instance;
+		}
+
+		/// <summary>
+		/// Adds a default value that will be written to the file at the end of the frame.
+		/// If no task interface is available, the value is written immediately.
+		/// </summary>
+		void Add(std::string& path, std::string& section, std::string& key, std::string& value) {
+			std::vector<std::pair<std::string, std::string>> settings;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				pending[path][EntryId(section, key)] = Entry{ section, key, value };
+				if (g_taskInterface == nullptr) {
+					settings = WriteFile(path, pending[path]);
+					pending.erase(path);
+				}
+				else if (!flushScheduled) {
+					flushScheduled = true;
+					g_taskInterface->AddTask(new FlushTask());
+				}
+			}
+			if (!settings.empty()) {
+				FileWritten(path, settings);
+			}
+		}
+
+		/// <summary>
+		/// Returns true and sets value, if a default value is pending for the setting.
+		/// </summary>
+		bool Get(std::string& path, std::string& section, std::string& key, std::string& value) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto file = pending.find(path);
+			if (file == pending.end()) {
+				return false;
+			}
+			auto entry = file->second.find(EntryId(section, key));
+			if (entry == file->second.end()) {
+				return false;
+			}
+			value = entry->second.value;
+			return true;
+		}
+
+		/// <summary>
+		/// Removes a pending default value, because a value was written explicitly.
+		/// </summary>
+		void Discard(std::string& path, std::string& section, std::string& key) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto file = pending.find(path);
+			if (file != pending.end()) {
+				file->second.erase(EntryId(section, key));
+			}
+		}
+
+		/// <summary>
+		/// Removes all pending default values of a section, because the section was replaced.
+		/// </summary>
+		void DiscardSection(std::string& path, std::string& section) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto file = pending.find(path);
+			if (file == pending.end()) {
+				return;
+			}
+			auto lowerSection = ToLower(section);
+			for (auto it = file->second.begin(); it != file->second.end();) {
+				if (ToLower(it->second.section).compare(lowerSection) == 0) {
+					it = file->second.erase(it);
+				}
+				else {
+					++it;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Writes the pending default values of a single file. Returns true, if values were pending.
+		/// notify is false, when the IniHandler flushes right before it loads the cache of the file, since the loaded cache sees the values anyway.
+		/// </summary>
+		bool Flush(const std::string& path, bool notify = true) {
+			std::vector<std::pair<std::string, std::string>> settings;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto file = pending.find(path);
+				if (file == pending.end()) {
+					return false;
+				}
+				settings = WriteFile(path, file->second);
+				pending.erase(file);
+			}
+			if (notify) {
+				FileWritten(path, settings);
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// Writes the pending default values of all files.
+		/// </summary>
+		void FlushAll() {
+			std::vector<std::pair<std::string, std::vector<std::pair<std::string, std::string>>>> written;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				for (auto& it : pending) {
+					written.push_back(std::make_pair(it.first, WriteFile(it.first, it.second)));
+				}
+				pending.clear();
+				flushScheduled = false;
+			}
+			for (auto& it : written) {
+				FileWritten(it.first, it.second);
+			}
+		}
+	};
+
+	/// <summary>
+	/// Watches the directories of buffered files for outside changes on a background thread and tells the IniHandler about them.
+	/// Directory change notifications are a Windows API, so the platform specific part is limited to Run.
+	/// </summary>
+	class FileWatcher {
+	private:
+		std::mutex lock;
+		// directory -> paths of the watched files in it
+		std::unordered_map<std::string, std::set<std::string>> directories;
+		std::thread thread;
+		std::atomic<bool> running = false;
+		std::mutex enableLock;
+		// signaled to make the thread update its directories or stop
+		HANDLE wakeEvent = nullptr;
+
+		static std::string DirectoryOf(const std::string& path) {
+			auto directory = std::filesystem::path(path).parent_path().string();
+			return directory.compare("") == 0 ? std::string(".") : directory;
+		}
+
+		void Run();
+	public:
+		static auto GetInstance() -> FileWatcher&
+		{
+			static FileWatcher instance;
+			return instance;
+		}
+
+		~FileWatcher() {
+			// the game is closing, so do not wait for the thread
+			if (thread.joinable()) {
+				thread.detach();
+			}
+		}
+
+		bool IsEnabled() {
+			return running;
+		}
+
+		void SetEnabled(bool enabled) {
+			std::lock_guard<std::mutex> guard(enableLock);
+			if (enabled == running) {
+				return;
+			}
+			if (enabled) {
+				wakeEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+				running = true;
+				thread = std::thread(&FileWatcher::Run, this);
+			}
+			else {
+				running = false;
+				SetEvent(wakeEvent);
+				thread.join();
+				CloseHandle(wakeEvent);
+				wakeEvent = nullptr;
+			}
+		}
+
+		void Watch(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			directories[DirectoryOf(path)].insert(path);
+			if (running) {
+				SetEvent(wakeEvent);
+			}
+		}
+
+		void Unwatch(const std::string& path) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto directory = directories.find(DirectoryOf(path));
+			if (directory == directories.end()) {
+				return;
+			}
+			directory->second.erase(path);
+			if (directory->second.empty()) {
+				directories.erase(directory);
+			}
+			if (running) {
+				SetEvent(wakeEvent);
+			}
+		}
+	};
+
+	/// <summary>
+	/// Records which files are buffered during the session in PREFETCH_PROFILE_FILE, so they can be loaded on a background thread at the next startup.
+	/// Mods can also declare files in manifests in PREFETCH_MANIFEST_DIR. Both use a [Prefetch] section with one key per path relative to the Data directory.
+	/// </summary>
+	class PrefetchProfile {
+	private:
+		std::mutex lock;
+		// paths relative to the Data directory
+		std::set<std::string> files;
+		bool saveScheduled = false;
+
+		class SaveTask : public TaskDelegate {
+		public:
+			virtual void Run() {
+				PrefetchProfile::GetInstance().Save();
+			}
+			virtual void Dispose() {
+				delete this;
+			}
+		};
+
+		static void ReadFiles(const std::string& path, std::vector<std::string>& result) {
+			CSimpleIniA ini;
+			if (ini.LoadFile(path.c_str()) < 0) {
+				return;
+			}
+			CSimpleIniA::TNamesDepend keys;
+			ini.GetAllKeys(PREFETCH_SECTION, keys);
+			keys.sort(CSimpleIniA::Entry::LoadOrder());
+			for (auto& key : keys) {
+				result.push_back(CanonicalPaths::GetInstance().Get(key.pItem));
+			}
+		}
+	public:
+		static auto GetInstance() -> PrefetchProfile&
+		{
+			static PrefetchProfile instance;
+			return instance;
+		}
+
+		/// <summary>
+		/// Returns the files of the profile of the last session and of all manifests.
+		/// </summary>
+		std::vector<std::string> GetFiles() {
+			std::vector<std::string> result;
+			ReadFiles(PREFETCH_PROFILE_FILE, result);
+			std::error_code error;
+			for (auto& entry : std::filesystem::directory_iterator(PREFETCH_MANIFEST_DIR, error)) {
+				if (entry.is_regular_file() && ToLower(entry.path().extension().string()).compare(".ini") == 0) {
+					ReadFiles(entry.path().string(), result);
+				}
+			}
+			std::sort(result.begin(), result.end());
+			result.erase(std::unique(result.begin(), result.end()), result.end());
+			return result;
+		}
+
+		/// <summary>
+		/// Records that the file was buffered in this session. The profile is written at the end of the frame.
+		/// </summary>
+		void Add(const std::string& path) {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto relative = path.compare(0, 5, "Data\\") == 0 ? path.substr(5) : path;
+				if (!files.insert(relative).second || (g_taskInterface != nullptr && saveScheduled)) {
+					return;
+				}
+				if (g_taskInterface != nullptr) {
+					saveScheduled = true;
+					g_taskInterface->AddTask(new SaveTask());
+					return;
+				}
+			}
+			Save();
+		}
+
+		/// <summary>
+		/// Replaces the files of the last session in the profile with the files of this session.
+		/// </summary>
+		void Save() {
+			std::string profile(PREFETCH_PROFILE_FILE);
+			CSimpleIniA ini;
+			ini.LoadFile(profile.c_str());
+			ini.Delete(PREFETCH_SECTION, nullptr);
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				saveScheduled = false;
+				for (auto& file : files) {
+					ini.SetValue(PREFETCH_SECTION, file.c_str(), "1");
+				}
+			}
+			FileHelper::CreateParentDir(profile);
+			if (ini.SaveFile(profile.c_str()) < 0) {
+				FileHelper::FileCannotBeSaved(profile);
+			}
+		}
+	};
+
+	class IniHandler {
+	private:
+		// keyed by canonical path, so different spellings of the same file share one cache
+		std::unordered_map <  std::string, std::shared_ptr<IniCache>> fileReaders;
+		std::mutex lock;
+		// path -> value of accessCounter at the last access, used to find the least recently used caches
+		std::unordered_map<std::string, UInt64> accessTimes;
+		UInt64 accessCounter = 0;
+		// maximum estimated memory of all caches in bytes, 0 if unlimited
+		size_t memoryBudget = 0;
+		UInt32 evictions = 0;
+		bool evictScheduled = false;
+
+		class EvictTask : public TaskDelegate {
+		public:
+			virtual void Run() {
+				IniHandler::GetInstance().Evict();
+			}
+			virtual void Dispose() {
+				delete this;
+			}
+		};
+
+		/// <summary>
+		/// Tells the IniCache of the path that the sections of the file were written without the cache.
+		/// </summary>
+		void CacheWritten(const std::string& path, const std::vector<std::string>& lowerSections) {
+			auto cache = FindIniCache(path);
+			if (cache != nullptr && cache->IsUsed()) {
+				cache->FileWritten();
+				return;
+			}
+			// prefetched caches and caches of included files are loaded again on their next use instead,
+			// but files including the file must resolve their sections again
+			for (auto& dependent : IncludeGraph::GetInstance().GetDependents(path)) {
+				auto dependentCache = FindIniCache(dependent);
+				if (dependentCache != nullptr) {
+					dependentCache->Invalidate(lowerSections);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Returns the caches that may be closed to fit into the memory budget, least recently used first, and sets excess to the bytes exceeding it.
+		/// Caches that are currently used are not returned. Must be called with the lock held.
+		/// </summary>
+		std::vector<std::pair<std::string, std::shared_ptr<IniCache>>> SelectEvictions(size_t& excess) {
+			std::vector<std::pair<std::string, std::shared_ptr<IniCache>>> result;
+			excess = 0;
+			if (memoryBudget == 0) {
+				return result;
+			}
+			size_t resident = 0;
+			std::vector<std::pair<UInt64, std::string>> candidates;
+			for (auto& it : fileReaders) {
+				resident += it.second->GetSize();
+				// the map holds the only reference to caches that are not used
+				if (it.second.use_count() == 1) {
+					candidates.push_back(std::make_pair(accessTimes[it.first], it.first));
+				}
+			}
+			if (resident <= memoryBudget) {
+				return result;
+			}
+			excess = resident - memoryBudget;
+			std::sort(candidates.begin(), candidates.end());
+			for (auto& candidate : candidates) {
+				result.push_back(std::make_pair(candidate.second, fileReaders.at(candidate.second)));
+			}
+			return result;
+		}
+
+		/// <summary>
+		/// Loads the file again and replaces cache with the loaded cache, if the file changed or force is true. Returns false, if it was not replaced.
+		/// The file is parsed without holding the lock. Users of the old cache can still read it until they are done, but their writes go to the reloaded one.
+		/// </summary>
+		bool Reload(const std::string& path, std::shared_ptr<IniCache>& cache, bool force = false) {
+			if (!force && !cache->MayNeedReload()) {
+				return false;
+			}
+			// the reloaded cache must see default values that were not written to the file yet
+			PendingDefaults::GetInstance().Flush(path, false);
+			auto loaded = std::make_shared<IniCache>(path);
+			std::lock_guard<std::mutex> guard(lock);
+			auto it = fileReaders.find(path);
+			if (it == fileReaders.end() || it->second != cache) {
+				// another thread reloaded or closed the cache while the file was parsed
+				if (it != fileReaders.end()) {
+					cache = it->second;
+				}
+				return false;
+			}
+			if (!cache->Retire(force)) {
+				return false;
+			}
+			// reloading a buffer, e.g. while resolving includes, must not hide it from the script API
+			if (cache->IsUsed()) {
+				loaded->MarkUsed();
+			}
+			it->second = loaded;
+			cache = loaded;
+			return true;
+		}
+	public:
+		static auto GetInstance() -> IniHandler&
+		{
+			static IniHandler instance;
+			return instance;
+		}
+
+		/// <summary>
+		/// Returns true, if a IniCache exists for the specified path.
+		/// </summary>
+		/// <param name="path">Path to the .ini file.</param>
+		/// <returns></returns>
+		bool HasIniCache(std::string path) {
+			std::lock_guard<std::mutex> guard(lock);
+			// prefetched caches that were not used yet do not change how non-buffered functions behave
+			auto it = fileReaders.find(path);
+			bool result = it != fileReaders.end() && it->second->IsUsed();
+			Logger::DebugMsg("HasIniCache: {" + path + "} -> return " + std::to_string(result));
+			return result;
+		}
+
+		/// <summary>
+		/// Loads a cache for the file in advance, if it exists and no cache exists yet. The file is parsed without holding the lock.
+		/// Prefetched caches are evicted first and are loaded again on their first use, if the file changed in the meantime.
+		/// If evict is false, no caches are closed, so a batch of prefetched files is not evicted before it is used. See Evict.
+		/// </summary>
+		void Prefetch(std::string path, bool evict = true) {
+			if (FileHelper::IsMissing(path) || !std::filesystem::exists(path) || FindIniCache(path) != nullptr) {
+				return;
+			}
+			PendingDefaults::GetInstance().Flush(path, false);
+			{
+				auto cache = std::make_shared<IniCache>(path);
+				std::lock_guard<std::mutex> guard(lock);
+				if (!fileReaders.emplace(path, cache).second) {
+					return;
+				}
+				// a batch is about to be used, so it is not the least recently used
+				accessTimes[path] = evict ? 0 : ++accessCounter;
+				FileWatcher::GetInstance().Watch(path);
+			}
+			if (evict) {
+				Evict();
+			}
+		}
+
+		/// <summary>
+		/// Closes the least recently used caches until all caches fit into the memory budget. Modified caches are saved first.
+		/// The caches are chosen while holding the lock, but saved without it. Caches that cannot be saved are not closed, so their changes are not lost,
+		/// and neither are caches that were used or written while they were saved.
+		/// </summary>
+		void Evict() {
+			size_t excess;
+			std::vector<std::pair<std::string, std::shared_ptr<IniCache>>> candidates;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				evictScheduled = false;
+				candidates = SelectEvictions(excess);
+			}
+			for (auto& candidate : candidates) {
+				if (excess == 0) {
+					break;
+				}
+				auto& cache = candidate.second;
+				auto size = cache->GetSize();
+				Logger::Msg("Evict Cache: {" + candidate.first + "} " + std::to_string(size) + " bytes");
+				if (!cache->Save()) {
+					Logger::Msg("Evict Cache: {" + candidate.first + "} -> keep unsaved changes");
+					continue;
+				}
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					auto it = fileReaders.find(candidate.first);
+					// besides the map, candidates holds a reference
+					if (it == fileReaders.end() || it->second != cache || cache.use_count() > 2 || cache->IsModified()) {
+						Logger::Msg("Evict Cache: {" + candidate.first + "} -> keep cache used in the meantime");
+						continue;
+					}
+					fileReaders.erase(it);
+					accessTimes.erase(candidate.first);
+					IncludeGraph::GetInstance().RemoveIncludes(candidate.first);
+					FileWatcher::GetInstance().Unwatch(candidate.first);
+					evictions++;
+				}
+				excess = excess > size ? excess - size : 0;
+			}
+		}
+
+		/// <summary>
+		/// Closes caches exceeding the memory budget at the end of the frame, since caches grow when they are written.
+		/// Called after every change of a cache, so the frame only checks the budget once. If no task interface is available, they are closed immediately.
+		/// </summary>
+		void CheckBudget() {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (memoryBudget == 0 || evictScheduled) {
+					return;
+				}
+				if (g_taskInterface != nullptr) {
+					evictScheduled = true;
+					g_taskInterface->AddTask(new EvictTask());
+					return;
+				}
+			}
+			Evict();
+		}
+
+		/// <summary>
+		/// Loads the cache of the path again, if the file changed outside and no further changes happened for RELOAD_DELAY_MS.
+		/// Called by the FileWatcher, so buffers see outside changes without waiting for a script to use them.
+		/// Returns false, if the change is still waited for.
+		/// </summary>
+		bool ReloadChanged(const std::string& path) {
+			auto cache = FindIniCache(path);
+			if (cache == nullptr) {
+				return true;
+			}
+			if (!Reload(path, cache)) {
+				return !cache->IsReloadPending();
+			}
+			Logger::DebugMsg("ReloadChanged: {" + path + "} -> reload changed");
+			// notifies subscribers and files including the reloaded file
+			cache->InvalidateAll();
+			return true;
+		}
+
+		/// <summary>
+		/// Returns a IniCache for the specified path. If it does not exist, a new one is created.
+		/// The returned IniCache stays valid while it is used, even if it is closed or evicted in the meantime.
+		/// Caches of included files are not marked as used, so they do not become buffers of the script API like prefetched caches.
+		/// </summary>
+		/// <param name="path">Path to the .ini file.</param>
+		/// <param name="use">False, if the cache is only read to resolve the includes of another file.</param>
+		/// <returns>A IniCache containing all values of the .ini file.</returns>
+		std::shared_ptr<IniCache> GetIniCache(std::string path, bool use = true) {
+			std::shared_ptr<IniCache> cache;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				accessTimes[path] = ++accessCounter;
+				auto it = fileReaders.find(path);
+				if (it != fileReaders.end()) {
+					cache = it->second;
+				}
+			}
+			bool reloaded = false;
+			if (cache == nullptr) {
+				Logger::DebugMsg("GetIniCache: {" + path + "} -> get new");
+				// the new cache must see default values that were not written to the file yet
+				PendingDefaults::GetInstance().Flush(path, false);
+				auto loaded = std::make_shared<IniCache>(path);
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					auto result = fileReaders.emplace(path, loaded);
+					// another thread may have created the cache while the file was parsed
+					cache = result.first->second;
+					if (result.second) {
+						FileWatcher::GetInstance().Watch(path);
+					}
+				}
+				// the new cache is referenced here, so it is not closed itself
+				Evict();
+			}
+			else {
+				// non-buffered reads do not see prefetched caches and caches of included files, so they may have added default values in the meantime
+				bool flushed = !cache->IsUsed() && PendingDefaults::GetInstance().Flush(path, false);
+				if (Reload(path, cache, flushed)) {
+					Logger::DebugMsg("GetIniCache: {" + path + "} -> reload changed");
+					reloaded = true;
+				}
+				else {
+					Logger::DebugMsg("GetIniCache: {" + path + "} -> get existing");
+				}
+			}
+			if (reloaded) {
+				// files including the reloaded file must resolve their sections again
+				cache->InvalidateAll();
+			}
+			if (use && cache->MarkUsed()) {
+				PrefetchProfile::GetInstance().Add(path);
+			}
+			return cache;
+		}
+
+		/// <summary>
+		/// Tells the IniCache of the path about an outside change. Returns true, if the file itself changed,
+		/// so the FileWatcher loads it again with ReloadChanged. Until then, it is loaded again on its next use.
+		/// </summary>
+		bool FileChanged(const std::string& path) {
+			auto cache = FindIniCache(path);
+			if (cache != nullptr) {
+				cache->FileChanged();
+				return cache->IsReloadPending();
+			}
+			return false;
+		}
+
+		/// <summary>
+		/// Tells the caches that the sections of the file were written without the cache.
+		/// </summary>
+		void FileWritten(const std::string& path, const std::vector<std::string>& lowerSections) {
+			Generations::GetInstance().Changed(path, lowerSections);
+			ChangeNotifier::GetInstance().Changed(path, lowerSections);
+			CacheWritten(path, lowerSections);
+		}
+
+		/// <summary>
+		/// Like FileWritten, but only the settings were written, so only their subscriptions and the subscriptions of their sections are notified.
+		/// </summary>
+		void FileWritten(const std::string& path, const std::vector<std::pair<std::string, std::string>>& settings) {
+			std::vector<std::string> lowerSections;
+			for (auto& setting : settings) {
+				lowerSections.push_back(ToLower(setting.first));
+			}
+			Generations::GetInstance().Changed(path, lowerSections);
+			ChangeNotifier::GetInstance().Changed(path, settings);
+			CacheWritten(path, lowerSections);
+		}
+
+		/// <summary>
+		/// Returns the IniCache for the specified path or nullptr, if it does not exist.
+		/// </summary>
+		std::shared_ptr<IniCache> FindIniCache(std::string path) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto it = fileReaders.find(path);
+			return it != fileReaders.end() ? it->second : nullptr;
+		}
+
+		/// <summary>
+		/// Sets the maximum estimated memory of all caches in bytes and closes caches exceeding it. 0 removes the limit.
+		/// </summary>
+		void SetMemoryBudget(size_t bytes) {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				memoryBudget = bytes;
+			}
+			Evict();
+		}
+
+		/// <summary>
+		/// Returns the estimated memory of all caches in bytes.
+		/// </summary>
+		size_t GetResidentBytes() {
+			std::lock_guard<std::mutex> guard(lock);
+			size_t resident = 0;
+			for (auto& it : fileReaders) {
+				resident += it.second->GetSize();
+			}
+			return resident;
+		}
+
+		UInt32 GetEvictionCount() {
+			std::lock_guard<std::mutex> guard(lock);
+			return evictions;
+		}
+
+		/// <summary>
+		/// Adds all existing IniCaches to the KeyIndex.
+		/// </summary>
+		void IndexAll() {
+			std::lock_guard<std::mutex> guard(lock);
+			for (auto& it : fileReaders) {
+				it.second->Index();
+			}
+		}
+
+		/// <summary>
+		/// Closes the IniCache for the specified path, writing the changes and freeing memory.
+		/// </summary>
+		/// <param name="path">Path to the .ini file.</param>
+		void CloseIniCache(std::string path) {
+			auto cache = FindIniCache(path);
+			if (cache == nullptr) {
+				Logger::DebugMsg("CloseIniCache: {" + path + "} -> does not exist");
+				return;
+			}
+			Logger::DebugMsg("CloseIniCache: {" + path + "} -> close existing");
+			// the file is written without holding the lock
+			cache->Save();
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = fileReaders.find(path);
+				if (it != fileReaders.end() && it->second == cache) {
+					fileReaders.erase(it);
+					accessTimes.erase(path);
+					IncludeGraph::GetInstance().RemoveIncludes(path);
+					FileWatcher::GetInstance().Unwatch(path);
+				}
+			}
+			// writes that happened while the cache was saved
+			if (cache->IsModified()) {
+				cache->Save();
+			}
+		}
+
+
+	};
+
+	/// <summary>
+	/// Threads that are started on first use and kept, so loading a batch of files does not start new threads every time.
+	/// </summary>
+	class WorkerPool {
+	private:
+		struct Batch {
+			std::function<void(size_t)> work;
+			size_t count = 0;
+			std::atomic<size_t> next = 0;
+			size_t done = 0;
+			std::mutex lock;
+			std::condition_variable finished;
+		};
+
+		std::mutex lock;
+		std::condition_variable wake;
+		std::deque<std::function<void()>> tasks;
+		std::vector<std::thread> threads;
+
+		/// <summary>
+		/// Takes indices of the batch until all are taken. Threads joining late find nothing left and return.
+		/// </summary>
+		static void RunBatch(std::shared_ptr<Batch> batch) {
+			for (size_t i = batch->next++; i < batch->count; i = batch->next++) {
+				batch->work(i);
+				std::lock_guard<std::mutex> guard(batch->lock);
+				if (++batch->done == batch->count) {
+					batch->finished.notify_all();
+				}
+			}
+		}
+
+		void Run() {
+			while (true) {
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					wake.wait(guard, [this]() { return !tasks.empty(); });
+					task = std::move(tasks.front());
+					tasks.pop_front();
+				}
+				task();
+			}
+		}
+
+		/// <summary>
+		/// Starts the threads on first use. Must be called with the lock held.
+		/// </summary>
+		void StartThreads() {
+			if (!threads.empty()) {
+				return;
+			}
+			auto threadCount = (std::max)(std::thread::hardware_concurrency(), 2u) - 1;
+			for (unsigned int i = 0; i < threadCount; i++) {
+				threads.emplace_back(&WorkerPool::Run, this);
+			}
+		}
+	public:
+		static auto GetInstance() -> WorkerPool&
+		{
+			static WorkerPool instance;
+			return instance;
+		}
+
+		~WorkerPool() {
+			// the game is closing, so do not wait for the threads
+			for (auto& thread : threads) {
+				thread.detach();
+			}
+		}
+
+		/// <summary>
+		/// Runs the task on one of the threads.
+		/// </summary>
+		void Add(std::function<void()> task) {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				StartThreads();
+				tasks.push_back(std::move(task));
+			}
+			wake.notify_one();
+		}
+
+		/// <summary>
+		/// Calls work for every index from 0 to count - 1 on the threads and the calling thread and returns when all calls are done.
+		/// The calling thread takes indices as well, so nested calls from a task cannot wait for each other.
+		/// </summary>
+		void ParallelFor(size_t count, std::function<void(size_t)> work) {
+			if (count == 0) {
+				return;
+			}
+			auto batch = std::make_shared<Batch>();
+			batch->work = std::move(work);
+			batch->count = count;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				StartThreads();
+				for (size_t i = 1; i < count && i <= threads.size(); i++) {
+					tasks.push_back([batch]() { RunBatch(batch); });
+				}
+			}
+			wake.notify_all();
+			RunBatch(batch);
+			std::unique_lock<std::mutex> guard(batch->lock);
+			batch->finished.wait(guard, [&batch]() { return batch->done == batch->count; });
+		}
+	};
+
+	/// <summary>
+	/// Loads the files of the prefetch profile and manifests on a background thread, so the first buffered reads find them already loaded.
+	/// </summary>
+	void StartPrefetch() {
+		auto files = PrefetchProfile::GetInstance().GetFiles();
+		if (files.empty()) {
+			return;
+		}
+		Logger::Msg("Prefetch: " + std::to_string(files.size()) + " files");
+		std::thread([files]() {
+			for (auto& path : files) {
+				IniHandler::GetInstance().Prefetch(path);
+			}
+		}).detach();
+	}
+
+	void FileWatcher::Run() {
+		// directory -> change notification handle, only used by this thread
+		std::unordered_map<std::string, HANDLE> handles;
+		// paths with outside changes, which are loaded again after no further changes happened for RELOAD_DELAY_MS
+		std::set<std::string> changed;
+		while (running) {
+			std::vector<std::string> waitDirectories;
+			std::vector<HANDLE> waitHandles{ wakeEvent };
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				for (auto it = handles.begin(); it != handles.end();) {
+					if (directories.find(it->first) == directories.end()) {
+						FindCloseChangeNotification(it->second);
+						it = handles.erase(it);
+					}
+					else {
+						++it;
+					}
+				}
+				for (auto& it : directories) {
+					if (waitHandles.size() == MAXIMUM_WAIT_OBJECTS) {
+						Logger::Error("FileWatcher: too many directories, changes in " + it.first + " are not detected");
+						continue;
+					}
+					auto handle = handles.find(it.first);
+					if (handle == handles.end()) {
+						auto newHandle = FindFirstChangeNotificationA(it.first.c_str(), FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+						if (newHandle == INVALID_HANDLE_VALUE) {
+							// the directory does not exist yet, try again when the directories change
+							continue;
+						}
+						handle = handles.emplace(it.first, newHandle).first;
+					}
+					waitDirectories.push_back(it.first);
+					waitHandles.push_back(handle->second);
+				}
+			}
+			auto result = WaitForMultipleObjects((DWORD)waitHandles.size(), waitHandles.data(), FALSE, changed.empty() ? INFINITE : RELOAD_DELAY_MS);
+			if (result == WAIT_FAILED) {
+				Logger::Error("FileWatcher: failed to wait for changes");
+				break;
+			}
+			for (auto it = changed.begin(); it != changed.end();) {
+				if (IniHandler::GetInstance().ReloadChanged(*it)) {
+					it = changed.erase(it);
+				}
+				else {
+					++it;
+				}
+			}
+			size_t index = result - WAIT_OBJECT_0;
+			if (result == WAIT_TIMEOUT || index == 0 || index >= waitHandles.size()) {
+				continue;
+			}
+			auto& directory = waitDirectories[index - 1];
+			FindNextChangeNotification(waitHandles[index]);
+			std::vector<std::string> paths;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = directories.find(directory);
+				if (it != directories.end()) {
+					paths.assign(it->second.begin(), it->second.end());
+				}
+			}
+			for (auto& path : paths) {
+				if (IniHandler::GetInstance().FileChanged(path)) {
+					changed.insert(path);
+				}
+			}
+		}
+		for (auto& it : handles) {
+			FindCloseChangeNotification(it.second);
+		}
+	}
+
+	std::shared_ptr<const FlatSection> IniCache::GetFlatSection(const std::string& lowerSection) {
+			CopyBound();
+		UInt32 generation;
+		{
+			std::lock_guard<std::mutex> guard(flatLock);
+			RemoveStaleSections();
+			auto it = flatSections.find(lowerSection);
+			if (it != flatSections.end()) {
+				return it->second;
+			}
+			generation = flatGeneration;
+		}
+		auto flat = std::make_shared<FlatSection>();
+		// bases are resolved first, since they have the lowest priority
+		auto base = bases.find(lowerSection);
+		if (base != bases.end()) {
+			flat->values = GetFlatSection(base->second)->values;
+		}
+		for (auto& include : includes) {
+			auto cache = IniHandler::GetInstance().GetIniCache(include, false);
+			for (auto& it : cache->GetFlatSection(lowerSection)->values) {
+				flat->values[it.first] = it.second;
+			}
+		}
+		{
+			std::shared_lock<std::shared_mutex> guard(lock);
+			auto raw = rawSections.find(lowerSection);
+			std::vector<std::string> names = raw != rawSections.end() ? raw->second : std::vector<std::string>{ lowerSection };
+			// the section declaring the base is first, so the other sections with the same name override it
+			for (auto& name : names) {
+				auto keyValues = ini.GetSection(name.c_str());
+				if (keyValues == nullptr) {
+					continue;
+				}
+				for (auto it = keyValues->begin(); it != keyValues->end(); it = keyValues->upper_bound(it->first)) {
+					flat->values[ToLower(it->first.pItem)] = it->second;
+				}
+			}
+		}
+		std::lock_guard<std::mutex> guard(flatLock);
+		RemoveStaleSections();
+		// only keep the result, if nothing changed while it was resolved
+		if (generation == flatGeneration) {
+			flatSections[lowerSection] = flat;
+		}
+		return flat;
+	}
+
+	void IniCache::Invalidate(std::vector<std::string> lowerSections) {
+		// sections inheriting from a changed section change as well
+		for (size_t i = 0; i < lowerSections.size(); i++) {
+			auto it = children.find(lowerSections[i]);
+			if (it != children.end()) {
+				lowerSections.insert(lowerSections.end(), it->second.begin(), it->second.end());
+			}
+		}
+		{
+			std::lock_guard<std::mutex> guard(staleLock);
+			staleSections.insert(lowerSections.begin(), lowerSections.end());
+			flatGeneration++;
+		}
+		ClearInterpolated();
+		Generations::GetInstance().Changed(path, lowerSections);
+		ChangeNotifier::GetInstance().Changed(path, lowerSections);
+		IniHandler::GetInstance().CheckBudget();
+		for (auto& dependent : IncludeGraph::GetInstance().GetDependents(path)) {
+			auto cache = IniHandler::GetInstance().FindIniCache(dependent);
+			if (cache != nullptr) {
+				cache->Invalidate(lowerSections);
+			}
+		}
+	}
+
+	void PendingDefaults::FileWritten(const std::string& path, const std::vector<std::pair<std::string, std::string>>& settings) {
+		IniHandler::GetInstance().FileWritten(path, settings);
+	}
+
+	std::shared_ptr<IniCache> IniCache::Current() {
+		return IniHandler::GetInstance().GetIniCache(path);
+	}
+
+	void IniCache::InvalidateAll() {
+		{
+			std::lock_guard<std::mutex> guard(staleLock);
+			allStale = true;
+			flatGeneration++;
+		}
+		ClearInterpolated();
+		Generations::GetInstance().ChangedAll(path);
+		ChangeNotifier::GetInstance().ChangedAll(path);
+		IniHandler::GetInstance().CheckBudget();
+		for (auto& dependent : IncludeGraph::GetInstance().GetDependents(path)) {
+			auto cache = IniHandler::GetInstance().FindIniCache(dependent);
+			if (cache != nullptr) {
+				cache->InvalidateAll();
+			}
+		}
+	}
+
+	/// <summary>
+	/// Transactions by handle. Writes are staged for a transaction by passing its handle, so each script only commits its own writes,
+	/// even if other scripts write to the same file or open their own transactions for it. Staged writes are not visible to reads.
+	/// Committing applies all staged writes at once with a single save. Rolling back discards them.
+	/// </summary>
+	class Transactions {
+	public:
+		struct Transaction {
+			std::string path;
+			bool cache = false;
+			std::vector<std::pair<std::string, std::string>> settings;
+			std::vector<std::string> values;
+			// lower case "section::key" -> index in settings
+			std::unordered_map<std::string, size_t> indices;
+		};
+	private:
+		std::mutex lock;
+		std::unordered_map<SInt32, Transaction> transactions;
+		SInt32 nextHandle = 1;
+
+		static void StageValue(Transaction& transaction, std::pair<std::string, std::string>& setting, std::string& value) {
+			auto id = ToLower(setting.first + SECTION_KEY_SEP + setting.second);
+			auto it = transaction.indices.find(id);
+			if (it != transaction.indices.end()) {
+				transaction.values[it->second] = value;
+			}
+			else {
+				transaction.indices.emplace(id, transaction.settings.size());
+				transaction.settings.push_back(setting);
+				transaction.values.push_back(value);
+			}
+		}
+	public:
+		static auto GetInstance() -> Transactions&
+		{
+			static Transactions instance;
+			return instance;
+		}
+
+		/// <summary>
+		/// Opens a transaction for the file and returns its handle.
+		/// </summary>
+		SInt32 Begin(std::string& path, bool cache) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto handle = nextHandle++;
+			auto& transaction = transactions[handle];
+			transaction.path = path;
+			transaction.cache = cache;
+			return handle;
+		}
+
+		/// <summary>
+		/// Stages the values for the transaction. Returns false, if the handle is invalid.
+		/// </summary>
+		bool Stage(SInt32 handle, std::vector<std::pair<std::string, std::string>>& settings, std::vector<std::string>& values) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto transaction = transactions.find(handle);
+			if (transaction == transactions.end()) {
+				return false;
+			}
+			Logger::DebugMsg("Stage Transaction: {" + transaction->second.path + "} " + std::to_string(settings.size()) + " values");
+			for (size_t i = 0; i < settings.size(); i++) {
+				StageValue(transaction->second, settings[i], values[i]);
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// Closes the transaction and moves its staged values to transaction. Returns false, if the handle is invalid.
+		/// </summary>
+		bool Take(SInt32 handle, Transaction& transaction) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto it = transactions.find(handle);
+			if (it == transactions.end()) {
+				return false;
+			}
+			transaction = std::move(it->second);
+			transactions.erase(it);
+			return true;
+		}
+	};
+
+	/// <summary>
+	/// Snapshots of IniCaches by handle. A snapshot stays valid until it is released, even if its cache is closed.
+	/// </summary>
+	class Snapshots {
+	private:
+		std::mutex lock;
+		std::unordered_map<SInt32, std::shared_ptr<const IniSnapshot>> snapshots;
+		SInt32 nextHandle = 1;
+	public:
+		static auto GetInstance() -> Snapshots&
+		{
+			static Snapshots instance;
+			return instance;
+		}
+
+		SInt32 Add(std::shared_ptr<const IniSnapshot> snapshot) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto handle = nextHandle++;
+			snapshots.emplace(handle, snapshot);
+			return handle;
+		}
+
+		/// <summary>
+		/// Returns the snapshot of the handle or nullptr, if the handle is invalid.
+		/// </summary>
+		std::shared_ptr<const IniSnapshot> Get(SInt32 handle) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto it = snapshots.find(handle);
+			return it != snapshots.end() ? it->second : nullptr;
+		}
+
+		bool Release(SInt32 handle) {
+			std::lock_guard<std::mutex> guard(lock);
+			return snapshots.erase(handle) > 0;
+		}
+	};
+
+	void CreateCache(std::string& fileName) {
+		IniHandler::GetInstance().GetIniCache(fileName);
+	}
+
+	/// <summary>
+	/// Creates buffers for all files in the directory matching the pattern. The files are parsed in parallel by one thread per core.
+	/// Without eventName, returns after all buffers were created. Otherwise returns immediately and sends eventName once they are created.
+	/// Returns the number of matching files. An empty pattern matches all files, like FindKeysMatching does not filter by an empty pattern.
+	/// </summary>
+	SInt32 CreateCachesForDirectory(std::string& directory, std::string& pattern, std::string& eventName) {
+		std::vector<std::string> files;
+		std::error_code error;
+		std::string filePattern = pattern.empty() ? std::string("*") : pattern;
+		for (auto& entry : std::filesystem::directory_iterator(CanonicalPaths::GetInstance().Get(directory), error)) {
+			auto name = entry.path().filename().string();
+			if (entry.is_regular_file() && MatchPattern(name, filePattern)) {
+				files.push_back(CanonicalPaths::GetInstance().Get(directory + "\\" + name));
+			}
+		}
+		if (error) {
+			Logger::Msg("Directory cannot be read: " + directory);
+		}
+		Logger::Msg("Create Caches: {" + directory + "} " + filePattern + " -> " + std::to_string(files.size()) + " files");
+		auto load = [files]() {
+			// nothing is evicted until all files are buffers, otherwise the batch would be evicted first as unused prefetched caches
+			WorkerPool::GetInstance().ParallelFor(files.size(), [&files](size_t i) {
+				IniHandler::GetInstance().Prefetch(files[i], false);
+			});
+			// the parsed caches become buffers on their first use
+			for (auto& file : files) {
+				IniHandler::GetInstance().GetIniCache(file);
+			}
+			IniHandler::GetInstance().Evict();
+		};
+		auto count = (SInt32)files.size();
+		if (eventName.empty()) {
+			load();
+		}
+		else {
+			WorkerPool::GetInstance().Add([load, eventName, directory, count]() {
+				load();
+				if (g_taskInterface != nullptr) {
+					g_taskInterface->AddTask(new SendEventTask(eventName, directory, (float)count));
+				}
+				else {
+					ChangeNotifier::GetInstance().Send(eventName, directory, (float)count);
+				}
+			});
+		}
+		return count;
+	}
+
+	void WriteCache(std::string& fileName) {
+		if (IniHandler::GetInstance().HasIniCache(fileName)) {
+			IniHandler::GetInstance().GetIniCache(fileName)->Save();
+		}
+	}
+
+	void CloseCache(std::string& fileName) {
+		IniHandler::GetInstance().CloseIniCache(fileName);
+	}
+
+	SInt32 SnapshotCache(std::string& fileName) {
+		return Snapshots::GetInstance().Add(IniHandler::GetInstance().GetIniCache(fileName)->Snapshot());
+	}
+
+	/// <summary>
+	/// Restores a snapshot of the same file. Returns false, if the handle is invalid or belongs to another file.
+	/// </summary>
+	bool RestoreCache(std::string& fileName, SInt32 handle) {
+		auto snapshot = Snapshots::GetInstance().Get(handle);
+		if (snapshot == nullptr) {
+			Logger::Error("Invalid snapshot handle: " + std::to_string(handle));
+			return false;
+		}
+		if (snapshot->path.compare(fileName) != 0) {
+			Logger::Error("Snapshot " + std::to_string(handle) + " of file " + snapshot->path + " cannot be restored to file: " + fileName);
+			return false;
+		}
+		IniHandler::GetInstance().GetIniCache(fileName)->Restore(*snapshot);
+		return true;
+	}
+
+	/// <summary>
+	/// Replaces the contents of the active file's cache with the contents of the profile file's cache.
+	/// The snapshot of the profile is only bound to the active cache and copied by its first read, write or save, see IniCache::Bind.
+	/// The active file is changed the next time its cache is saved.
+	/// </summary>
+	void SwitchProfile(std::string& activeFile, std::string& profileFile) {
+		if (activeFile.compare(profileFile) == 0) {
+			return;
+		}
+		Logger::DebugMsg("SwitchProfile: {" + activeFile + "} <- {" + profileFile + "}");
+		auto snapshot = IniHandler::GetInstance().GetIniCache(profileFile)->Snapshot();
+		IniHandler::GetInstance().GetIniCache(activeFile)->Bind(snapshot);
+	}
+
+	/// <summary>
+	/// Copies the sections of a file. If section is not empty, only that section is copied.
+	/// </summary>
+	void ReadSections(std::string& fileName, std::string& section, IniSnapshot& snapshot, bool cache) {
+		snapshot.path = fileName;
+		// read from cache, creating one if it does not exist
+		// or read from cache if it exists, but do not create a new one
+		if (cache || IniHandler::GetInstance().HasIniCache(fileName)) {
+			auto cacheSnapshot = IniHandler::GetInstance().GetIniCache(fileName)->Snapshot();
+			auto lowerSection = ToLower(section);
+			for (auto& it : cacheSnapshot->sections) {
+				if (section.compare("") == 0 || ToLower(it->section).compare(lowerSection) == 0) {
+					snapshot.sections.push_back(it);
+				}
+			}
+			return;
+		}
+		// read without cache, the file must contain the pending default values
+		PendingDefaults::GetInstance().Flush(fileName);
+		auto ini = LoadIniFile(fileName);
+		if (ini == nullptr) {
+			return;
+		}
+		CopySections(*ini, section, snapshot);
+	}
+
+	/// <summary>
+	/// Adds the sections of a snapshot to a file. If overwrite is false, values that already exist in the file are not changed.
+	/// A non-buffered merge only rewrites the file once.
+	/// </summary>
+	void MergeSections(std::string& fileName, IniSnapshot& snapshot, bool overwrite, bool cache) {
+		if (snapshot.sections.empty()) {
+			return;
+		}
+		// write to cache, creating one if it does not exist
+		if (cache) {
+			IniHandler::GetInstance().GetIniCache(fileName)->Merge(snapshot, overwrite);
+			return;
+		}
+		// write to cache if it exists, but do not create a new one
+		if (IniHandler::GetInstance().HasIniCache(fileName)) {
+			IniHandler::GetInstance().GetIniCache(fileName)->Merge(snapshot, overwrite);
+		}
+		// write without cache, the file must contain the pending default values, so they are not overwritten
+		PendingDefaults::GetInstance().Flush(fileName);
+		std::vector<std::pair<std::string, std::string>> settings;
+		std::vector<std::string> values;
+		for (auto& section : snapshot.sections) {
+			for (auto& entry : section->entries) {
+				settings.push_back(std::make_pair(section->section, entry.key));
+				values.push_back(entry.value);
+			}
+		}
+		WriteValues(fileName, settings, values, overwrite);
+		IniHandler::GetInstance().FileWritten(fileName, settings);
+	}
+
+	void MergeIni(std::string& srcFile, std::string& dstFile, bool overwrite, bool cache) {
+		if (srcFile.compare(dstFile) == 0) {
+			return;
+		}
+		Logger::DebugMsg("MergeIni: {" + dstFile + "} <- {" + srcFile + "} overwrite=" + std::to_string(overwrite));
+		IniSnapshot snapshot;
+		ReadSections(srcFile, std::string(""), snapshot, cache);
+		MergeSections(dstFile, snapshot, overwrite, cache);
+	}
+
+	/// <summary>
+	/// Copies all keys of a section to another file, overwriting existing values. Other keys of the section in dstFile are kept.
+	/// </summary>
+	void CopySection(std::string& srcFile, std::string& dstFile, std::string& section, bool cache) {
+		if (section.compare("") == 0) {
+			Logger::Msg("No section was copied for empty section name");
+			return;
+		}
+		if (srcFile.compare(dstFile) == 0) {
+			return;
+		}
+		Logger::DebugMsg("CopySection: {" + dstFile + "} <- {" + srcFile + "}[" + section + "]");
+		IniSnapshot snapshot;
+		ReadSections(srcFile, section, snapshot, cache);
+		MergeSections(dstFile, snapshot, true, cache);
+	}
+
+	void ReleaseSnapshot(SInt32 handle) {
+		if (!Snapshots::GetInstance().Release(handle)) {
+			Logger::Error("Invalid snapshot handle: " + std::to_string(handle));
+		}
+	}
+
+	std::pair<std::string, std::string> ExtractSettingAndKey(std::string& settingName) {
+		auto colonIndex = settingName.find(':');
+		if (colonIndex == -1) {
+			Logger::Error("Invalid setting name: \"" + settingName + "\"");
+			return std::make_pair<std::string, std::string>("", "");
+		}
+		auto key = settingName.substr(0, colonIndex);
+		auto section = settingName.substr(colonIndex + 1);
+		return std::pair<std::string, std::string>(section, key);
+	}
+
+	/// <summary>
+	/// Writes a single value to the file without the cache.
+	/// </summary>
+	void WriteFileSetting(std::string& fileName, std::string& section, std::string& key, std::string& value) {
+		PendingDefaults::GetInstance().Discard(fileName, section, key);
+		FileHelper::CreateParentDir(fileName);
+		ReadCache::GetInstance().Invalidate(fileName);
+		if (!WritePrivateProfileStringA(section.c_str(), key.c_str(), value.c_str(), fileName.c_str())) {
+			Logger::Msg("Failed to write file: " + fileName);
+			Logger::Msg("	 Check that the path is correct and the file is not protected or read-only.");
+			return;
+		}
+		KeyIndex::GetInstance().Add(fileName, section, key);
+		IniHandler::GetInstance().FileWritten(fileName, { std::make_pair(section, key) });
+	}
+
+	/// <summary>
+	/// Writes a single value.
+	/// </summary>
+	void WriteSetting(std::string& fileName, std::string& section, std::string& key, std::string& value, bool cache) {
+		Logger::DebugMsg("Write File: " + IniAccess(fileName, section, key) + " value=" + value);
+		// write to cache, creating one if it does not exist
+		if (cache) {
+			IniHandler::GetInstance().GetIniCache(fileName)->Write(section, key, value);
+		}
+		else {
+			// write to cache if it exists, but do not create a new one
+			if (IniHandler::GetInstance().HasIniCache(fileName)) {
+				IniHandler::GetInstance().GetIniCache(fileName)->Write(section, key, value);
+			}
+			// write without cache
+			WriteFileSetting(fileName, section, key, value);
+		}
+	}
+
+	void WriteString(std::string& fileName, std::string& settingName, std::string& value, bool cache) {
+		auto pair = ExtractSettingAndKey(settingName);
+		auto& section = pair.first;
+		auto& key = pair.second;
+		if (section.compare("") == 0 || key.compare("") == 0) {
+			Logger::Msg("No value was written for setting name: \"" + settingName + "\"");
+			return;
+		}
+		WriteSetting(fileName, section, key, value, cache);
+	}
+
+	/// <summary>
+	/// Writes multiple values to the same file. A non-buffered write only rewrites the file once.
+	/// </summary>
+	void WriteSettings(std::string& fileName, std::vector<std::pair<std::string, std::string>>& settings, std::vector<std::string>& validValues, bool cache) {
+		Logger::DebugMsg("Write File: {" + fileName + "} " + std::to_string(settings.size()) + " values");
+		// write to cache, creating one if it does not exist
+		if (cache) {
+			IniHandler::GetInstance().GetIniCache(fileName)->Write(settings, validValues);
+		}
+		else {
+			// write to cache if it exists, but do not create a new one
+			if (IniHandler::GetInstance().HasIniCache(fileName)) {
+				IniHandler::GetInstance().GetIniCache(fileName)->Write(settings, validValues);
+			}
+			// write without cache
+			for (auto& setting : settings) {
+				PendingDefaults::GetInstance().Discard(fileName, setting.first, setting.second);
+			}
+			WriteValues(fileName, settings, validValues, true);
+			IniHandler::GetInstance().FileWritten(fileName, settings);
+		}
+	}
+
+	/// <summary>
+	/// Writes multiple settings to the same file. The file is only resolved once and a non-buffered write only rewrites the file once.
+	/// </summary>
+	void WriteStrings(std::string& fileName, std::vector<std::string>& settingNames, std::vector<std::string>& values, bool cache) {
+		if (settingNames.size() != values.size()) {
+			Logger::Error("Different number of setting names and values: " + std::to_string(settingNames.size()) + " and " + std::to_string(values.size()));
+		}
+		std::vector<std::pair<std::string, std::string>> settings;
+		std::vector<std::string> validValues;
+		for (size_t i = 0; i < settingNames.size() && i < values.size(); i++) {
+			auto pair = ExtractSettingAndKey(settingNames[i]);
+			if (pair.first.compare("") == 0 || pair.second.compare("") == 0) {
+				Logger::Msg("No value was written for setting name: \"" + settingNames[i] + "\"");
+				continue;
+			}
+			settings.push_back(pair);
+			validValues.push_back(values[i]);
+		}
+		if (settings.empty()) {
+			return;
+		}
+		WriteSettings(fileName, settings, validValues, cache);
+	}
+
+	SInt32 BeginTransaction(std::string& fileName, bool cache) {
+		return Transactions::GetInstance().Begin(fileName, cache);
+	}
+
+	/// <summary>
+	/// Stages a write for the transaction instead of writing it.
+	/// </summary>
+	void TransactionWriteString(SInt32 handle, std::string& settingName, std::string& value) {
+		auto pair = ExtractSettingAndKey(settingName);
+		if (pair.first.compare("") == 0 || pair.second.compare("") == 0) {
+			Logger::Msg("No value was staged for setting name: \"" + settingName + "\"");
+			return;
+		}
+		std::vector<std::pair<std::string, std::string>> settings{ pair };
+		std::vector<std::string> values{ value };
+		if (!Transactions::GetInstance().Stage(handle, settings, values)) {
+			Logger::Error("No transaction to write to for handle: " + std::to_string(handle));
+		}
+	}
+
+	/// <summary>
+	/// Applies all staged writes at once. A non-buffered transaction rewrites the file once, a buffered transaction writes the buffer once.
+	/// </summary>
+	void CommitTransaction(SInt32 handle) {
+		Transactions::Transaction transaction;
+		if (!Transactions::GetInstance().Take(handle, transaction)) {
+			Logger::Error("No transaction to commit for handle: " + std::to_string(handle));
+			return;
+		}
+		if (transaction.settings.empty()) {
+			return;
+		}
+		WriteSettings(transaction.path, transaction.settings, transaction.values, transaction.cache);
+		if (transaction.cache) {
+			IniHandler::GetInstance().GetIniCache(transaction.path)->Save();
+		}
+	}
+
+	void RollbackTransaction(SInt32 handle) {
+		Transactions::Transaction transaction;
+		if (!Transactions::GetInstance().Take(handle, transaction)) {
+			Logger::Error("No transaction to roll back for handle: " + std::to_string(handle));
+		}
+	}
+
+	/// <summary>
+	/// Writes all keys of a section at once. If replace is true, all other keys of the section are removed.
+	/// A non-buffered write only rewrites the file once.
+	/// </summary>
+	void WriteSection(std::string& fileName, std::string& section, std::vector<std::string>& keys, std::vector<std::string>& values, bool replace, bool cache) {
+		if (section.compare("") == 0) {
+			Logger::Msg("No section was written for empty section name");
+			return;
+		}
+		if (keys.size() != values.size()) {
+			Logger::Error("Different number of keys and values: " + std::to_string(keys.size()) + " and " + std::to_string(values.size()));
+		}
+
+		Logger::DebugMsg("Write File Section: {" + fileName + "}[" + section + "] " + std::to_string(keys.size()) + " values");
+		// write to cache, creating one if it does not exist
+		if (cache) {
+			IniHandler::GetInstance().GetIniCache(fileName)->WriteSection(section, keys, values, replace);
+			return;
+		}
+		// write to cache if it exists, but do not create a new one
+		if (IniHandler::GetInstance().HasIniCache(fileName)) {
+			IniHandler::GetInstance().GetIniCache(fileName)->WriteSection(section, keys, values, replace);
+		}
+		// write without cache
+		if (replace) {
+			PendingDefaults::GetInstance().DiscardSection(fileName, section);
+		}
+		else {
+			for (auto& key : keys) {
+				PendingDefaults::GetInstance().Discard(fileName, section, key);
+			}
+		}
+		ReadCache::GetInstance().Invalidate(fileName);
+		CSimpleIniA ini;
+		// keeps duplicate keys of other sections, which the file would lose otherwise
+		ini.SetMultiKey(true);
+		SI_Error rc = ini.LoadFile(fileName.c_str());
+		if (rc < 0 && std::filesystem::exists(fileName)) {
+			// the file exists, but cannot be parsed, so do not replace it
+			bool success = true;
+			if (replace) {
+				std::string keyValues;
+				for (size_t i = 0; i < keys.size() && i < values.size(); i++) {
+					keyValues += keys[i] + "=" + values[i];
+					keyValues.push_back('\0');
+				}
+				success = WritePrivateProfileSectionA(section.c_str(), keyValues.c_str(), fileName.c_str());
+			}
+			else {
+				for (size_t i = 0; i < keys.size() && i < values.size() && success; i++) {
+					success = WritePrivateProfileStringA(section.c_str(), keys[i].c_str(), values[i].c_str(), fileName.c_str());
+				}
+			}
+			if (!success) {
+				Logger::Msg("Failed to write file: " + fileName);
+				Logger::Msg("	 Check that the path is correct and the file is not protected or read-only.");
+			}
+			IniHandler::GetInstance().FileWritten(fileName, { ToLower(section) });
+			return;
+		}
+		if (WriteSectionEntries(ini, section, keys, values, replace)) {
+			FileHelper::CreateParentDir(fileName);
+			rc = ini.SaveFile(fileName.c_str());
+			if (rc < 0) {
+				FileHelper::FileCannotBeSaved(fileName);
+				return;
+			}
+			KeyIndex::GetInstance().IndexFile(fileName, ini);
+			IniHandler::GetInstance().FileWritten(fileName, { ToLower(section) });
+		}
+	}
+
+	void WriteInt(std::string& fileName, std::string& settingName, SInt32 value, bool cache) { WriteString(fileName, settingName, std::to_string(value), cache); }
+	void WriteBool(std::string& fileName, std::string& settingName, bool value, bool cache) { WriteString(fileName, settingName, std::string(value ? "1" : "0"), cache); }
+	void WriteFloat(std::string& fileName, std::string& settingName, float value, bool cache) { WriteString(fileName, settingName, std::to_string(value), cache); }
+
+	/// <summary>
+	/// Writes a missing default value for the ReadEx functions.
+	/// Non-buffered default values are collected and written together at the end of the frame.
+	/// </summary>
+	void WriteDefaultString(std::string& fileName, std::string& settingName, std::string& value, bool cache) {
+		if (cache) {
+			WriteString(fileName, settingName, value, cache);
+			return;
+		}
+
+		auto pair = ExtractSettingAndKey(settingName);
+		auto& section = pair.first;
+		auto& key = pair.second;
+		if (section.compare("") == 0 || key.compare("") == 0) {
+			Logger::Msg("No value was written for setting name: \"" + settingName + "\"");
+			return;
+		}
+
+		Logger::DebugMsg("Write Default: " + IniAccess(fileName, section, key) + " value=" + value);
+		// write to cache if it exists, but do not create a new one
+		if (IniHandler::GetInstance().HasIniCache(fileName)) {
+			IniHandler::GetInstance().GetIniCache(fileName)->Write(section, key, value);
+		}
+		PendingDefaults::GetInstance().Add(fileName, section, key, value);
+	}
+
+	void WriteDefaultInt(std::string& fileName, std::string& settingName, SInt32 value, bool cache) { WriteDefaultString(fileName, settingName, std::to_string(value), cache); }
+	void WriteDefaultBool(std::string& fileName, std::string& settingName, bool value, bool cache) { WriteDefaultString(fileName, settingName, std::string(value ? "1" : "0"), cache); }
+	void WriteDefaultFloat(std::string& fileName, std::string& settingName, float value, bool cache) { WriteDefaultString(fileName, settingName, std::to_string(value), cache); }
+
+	void CloseReader(std::string& fileName) {
+		IniHandler::GetInstance().CloseIniCache(fileName);
+	}
+
+	/// <summary>
+	/// Shortens a value read without GetPrivateProfileStringA to bufferSize characters, like GetPrivateProfileStringA does.
+	/// </summary>
+	void TruncateValue(std::string& value, SInt32 bufferSize) {
+		if (bufferSize >= 0 && value.size() > (size_t)bufferSize) {
+			value.resize(bufferSize);
+		}
+	}
+
+	/// <summary>
+	/// GetPrivateProfileStringA does not report missing files, but returns the default value for them.
+	/// Only then the file is checked, so reads of existing files do not access the file system a second time,
+	/// and later reads of a missing file skip it for FILE_METADATA_TTL_MS.
+	/// </summary>
+	void RememberIfMissing(std::string& fileName, std::string& value, std::string& def) {
+		// the default value may have been cut off by the buffer size
+		if (value.size() <= def.size() && def.compare(0, value.size(), value) == 0) {
+			FileHelper::Exists(fileName);
+		}
+	}
+
+	std::string ReadString(std::string& fileName, std::string& settingName, std::string& def, bool cache, SInt32 bufferSize) {
+		auto pair = ExtractSettingAndKey(settingName);
+		auto& section = pair.first;
+		auto& key = pair.second;
+
+		if (section.compare("") == 0 || key.compare("") == 0) {
+			Logger::Msg("No value was read for setting name: \"" + settingName + "\"");
+			return def;
+		}
+
+		std::string value;
+		// read from cache, creating one if it does not exist
+		if (cache) {
+			value = IniHandler::GetInstance().GetIniCache(fileName)->Read(section, key, def);
+		}
+		else {
+			// read from cache if it exists, but do not create a new one
+			if (IniHandler::GetInstance().HasIniCache(fileName)) {
+				return ReadString(fileName, settingName, def, true, bufferSize);
+			}
+			// read default values that have not been written to the file yet
+			if (PendingDefaults::GetInstance().Get(fileName, section, key, value)) {
+				TruncateValue(value, bufferSize);
+				Logger::DebugMsg("Read Pending: " + IniAccess(fileName, section, key) + " value=" + value);
+				return value;
+			}
+			// a file that was missing recently only has default values
+			if (FileHelper::IsMissing(fileName)) {
+				value = def;
+				TruncateValue(value, bufferSize);
+				return value;
+			}
+			// read from the ReadCache, which behaves like reading the file
+			if (UseReadCache(fileName)) {
+				auto ini = ReadCache::GetInstance().Get(fileName);
+				if (ini == nullptr || !GetFileValue(*ini, section, key, value)) {
+					value = def;
+				}
+				TruncateValue(value, bufferSize);
+				Logger::DebugMsg("Read ReadCache: " + IniAccess(fileName, section, key) + " value=" + value);
+				return value;
+			}
+			// read without cache
+			if (bufferSize < 0) {
+				// GetPrivateProfileStringA cuts off values that do not fit, so the buffer grows until the whole value fits
+				std::vector<char> buffer(FULL_VALUE_BUFFER_SIZE);
+				DWORD length;
+				while ((length = GetPrivateProfileStringA(section.c_str(), key.c_str(), def.c_str(), buffer.data(), (DWORD)buffer.size(), fileName.c_str())) >= buffer.size() - 1) {
+					buffer.resize(buffer.size() * 2);
+				}
+				if (length > 0) {
+					value = std::string(buffer.data(), length);
+					RememberIfMissing(fileName, value, def);
+				}
+				else {
+					FileHelper::FileCannotBeLoaded(fileName);
+				}
+				Logger::DebugMsg("Read File: " + IniAccess(fileName, section, key) + " value=" + value);
+				return value;
+			}
+			char* inBuf;
+
+#if LEGENDARY_EDITION
+			inBuf = (char*)FormHeap_Allocate(sizeof(char) * (bufferSize + 1));
+#else
+			inBuf = (char*)Heap_Allocate(sizeof(char) * (bufferSize + 1));
+#endif
+
+			if (GetPrivateProfileStringA(section.c_str(), key.c_str(), def.c_str(), inBuf, bufferSize+1, fileName.c_str())) {
+				value = std::string(inBuf);
+				RememberIfMissing(fileName, value, def);
+			}
+			else {
+				FileHelper::FileCannotBeLoaded(fileName);
+			}
+			Logger::DebugMsg("Read File: " + IniAccess(fileName, section, key) + " value=" + value);
+		}
+		return value;
+	}
+
+	/// <summary>
+	/// Sends the events of all subscriptions affected by the changes since the last dispatch.
+	/// The values of setting subscriptions are read without holding the lock, since reading may load or flatten buffers.
+	/// </summary>
+	void ChangeNotifier::Dispatch() {
+		std::vector<std::pair<std::string, Subscription>> affected;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			dispatchScheduled = false;
+			for (auto& file : subscriptions) {
+				bool all = allChanged.count(file.first) > 0;
+				auto sections = changed.find(file.first);
+				auto keys = changedKeys.find(file.first);
+				for (auto& subscription : file.second) {
+					bool sectionChanged = sections != changed.end() && sections->second.count(subscription.section) > 0;
+					// section subscriptions are affected by any changed key of the section, setting subscriptions only by their own key
+					bool keyChanged = false;
+					if (keys != changedKeys.end()) {
+						auto sectionKeys = keys->second.find(subscription.section);
+						keyChanged = sectionKeys != keys->second.end() && (subscription.key.empty() || sectionKeys->second.count(subscription.key) > 0);
+					}
+					if (all || sectionChanged || keyChanged) {
+						affected.push_back(std::make_pair(file.first, subscription));
+					}
+				}
+			}
+			changed.clear();
+			changedKeys.clear();
+			allChanged.clear();
+		}
+		if (affected.empty()) {
+			return;
+		}
+		std::vector<std::pair<std::string, Subscription>> events;
+		std::string empty("");
+		for (auto& it : affected) {
+			auto& path = it.first;
+			auto& subscription = it.second;
+			if (subscription.key.empty()) {
+				events.push_back(it);
+				continue;
+			}
+			auto settingName = subscription.key + ":" + subscription.section;
+			auto value = ReadString(path, settingName, empty, false, FULL_VALUE);
+			std::lock_guard<std::mutex> guard(lock);
+			auto file = subscriptions.find(path);
+			if (file == subscriptions.end()) {
+				continue;
+			}
+			for (auto& current : file->second) {
+				if (current.section == subscription.section && current.key == subscription.key && current.eventName == subscription.eventName
+					&& current.lastValue != value) {
+					current.lastValue = value;
+					events.push_back(it);
+				}
+			}
+		}
+		for (auto& it : events) {
+			Logger::DebugMsg("Notify: {" + it.first + "} " + it.second.name + " -> " + it.second.eventName);
+			sink->Send(it.second.eventName, it.second.name, (float)Generations::GetInstance().GetFile(it.first));
+		}
+	}
+
+	void SubscribeToSetting(std::string& fileName, std::string& settingName, std::string& eventName) {
+		auto pair = ExtractSettingAndKey(settingName);
+		if (pair.first.compare("") == 0 || pair.second.compare("") == 0) {
+			Logger::Msg("No subscription for setting name: \"" + settingName + "\"");
+			return;
+		}
+		std::string empty("");
+		auto value = ReadString(fileName, settingName, empty, false, FULL_VALUE);
+		ChangeNotifier::GetInstance().Subscribe(fileName, pair.first, pair.second, settingName, eventName, value);
+	}
+
+	void SubscribeToSection(std::string& fileName, std::string& section, std::string& eventName) {
+		ChangeNotifier::GetInstance().Subscribe(fileName, section, std::string(""), section, eventName, std::string(""));
+	}
+
+	/// <summary>
+	/// Reads multiple settings from the same file. The file is only resolved once and all settings are looked up in a single pass.
+	/// Sets found[i], if settingNames[i] exists.
+	/// </summary>
+	void ReadStrings(std::string& fileName, std::vector<std::string>& settingNames, std::vector<std::string>& values, std::vector<bool>& found, bool cache) {
+		std::vector<std::pair<std::string, std::string>> settings;
+		settings.reserve(settingNames.size());
+		for (auto& settingName : settingNames) {
+			settings.push_back(ExtractSettingAndKey(settingName));
+		}
+		values.assign(settings.size(), std::string());
+		found.assign(settings.size(), false);
+
+		// read from cache, creating one if it does not exist
+		// or read from cache if it exists, but do not create a new one
+		if (cache || IniHandler::GetInstance().HasIniCache(fileName)) {
+			IniHandler::GetInstance().GetIniCache(fileName)->Read(settings, values, found);
+			return;
+		}
+		// read without cache, parsing the file once instead of once per setting
+		auto ini = LoadIniFile(fileName);
+		if (ini != nullptr) {
+			ReadFileValues(*ini, settings, values, found);
+		}
+		// read default values that have not been written to the file yet
+		for (size_t i = 0; i < settings.size(); i++) {
+			if (PendingDefaults::GetInstance().Get(fileName, settings[i].first, settings[i].second, values[i])) {
+				found[i] = true;
+			}
+		}
+		Logger::DebugMsg("Read File: {" + fileName + "} " + std::to_string(settings.size()) + " values");
+	}
+
+	/// <summary>
+	/// Reads a page of the keys and/or values of a section. keys and values may be nullptr, if they are not needed.
+	/// </summary>
+	void ReadSection(std::string& fileName, std::string& section, SInt32 start, SInt32 count, std::vector<std::string>* keys, std::vector<std::string>* values, bool cache) {
+		count = (std::min)(count, (SInt32)MAX_ARRAY_SIZE);
+		// read from cache, creating one if it does not exist
+		// or read from cache if it exists, but do not create a new one
+		if (cache || IniHandler::GetInstance().HasIniCache(fileName)) {
+			IniHandler::GetInstance().GetIniCache(fileName)->ReadSection(section, start, count, keys, values);
+			return;
+		}
+		// read without cache, the file must contain the pending default values
+		PendingDefaults::GetInstance().Flush(fileName);
+		auto ini = LoadIniFile(fileName);
+		if (ini == nullptr) {
+			return;
+		}
+		auto first = values != nullptr ? values->size() : 0;
+		ReadSectionEntries(ini->GetSection(section.c_str()), start, count, keys, values);
+		// like GetFileValue, so the values are the same as the values of single reads
+		for (size_t i = first; values != nullptr && i < values->size(); i++) {
+			RemoveQuotes((*values)[i]);
+		}
+	}
+
+	/// <summary>
+	/// Finds the keys of a section that start with prefix and match pattern, if pattern is not empty.
+	/// </summary>
+	std::vector<std::string> FindKeys(std::string& fileName, std::string& section, std::string& prefix, std::string& pattern, bool cache) {
+		if (cache || IniHandler::GetInstance().HasIniCache(fileName)) {
+			return IniHandler::GetInstance().GetIniCache(fileName)->FindKeys(section, prefix, pattern);
+		}
+		std::vector<std::string> keys;
+		PendingDefaults::GetInstance().Flush(fileName);
+		auto ini = LoadIniFile(fileName);
+		if (ini == nullptr) {
+			return keys;
+		}
+		FindSectionKeys(ini->GetSection(section.c_str()), prefix, pattern, keys);
+		return keys;
+	}
+
+	/// <summary>
+	/// Finds the keys of a section that match a pattern with '*' and '?' wildcards.
+	/// Only the keys starting with the literal part of the pattern before the first wildcard are scanned.
+	/// </summary>
+	std::vector<std::string> FindKeysMatching(std::string& fileName, std::string& section, std::string& pattern, bool cache) {
+		auto prefix = pattern.substr(0, pattern.find_first_of("*?"));
+		return FindKeys(fileName, section, prefix, pattern, cache);
+	}
+
+	SInt32 GetSectionSize(std::string& fileName, std::string& section, bool cache) {
+		if (cache || IniHandler::GetInstance().HasIniCache(fileName)) {
+			return IniHandler::GetInstance().GetIniCache(fileName)->GetSectionSize(section);
+		}
+		PendingDefaults::GetInstance().Flush(fileName);
+		auto ini = LoadIniFile(fileName);
+		if (ini == nullptr) {
+			return 0;
+		}
+		return (std::max)(ini->GetSectionSize(section.c_str()), 0);
+	}
+
+	SInt32 ParseInt(std::string value, SInt32 def) {
+		try {
+			return std::stoi(value);
+		}
+		catch (std::invalid_argument) {
+			return def;
+		}
+		catch (std::out_of_range) {
+			return def;
+		}
+	}
+
+	float ParseFloat(std::string value, float def) {
+		try {
+			return std::stof(value);
+		}
+		catch (std::invalid_argument) {
+			return def;
+		}
+		catch (std::out_of_range) {
+			return def;
+		}
+	}
+
+	bool ParseBool(std::string value, bool def) {
+		return ParseInt(value, def ? 1 : 0) == 1;
+	}
+
+	SInt32 ReadInt(std::string& fileName, std::string& settingName, SInt32 def, bool cache) {
+		return ParseInt(ReadString(fileName, settingName, std::to_string(def), cache, BUFFER_SIZE), def);
+	}
+
+	float ReadFloat(std::string& fileName, std::string& settingName, float def, bool cache) {
+		return ParseFloat(ReadString(fileName, settingName, std::to_string(def), cache, BUFFER_SIZE), def);
 	}
 
-	std::pair<std::string, std::string> ExtractSettingAndKey(std::string& settingName) {
-		auto colonIndex = settingName.find(':');
-		if (colonIndex == -1) {
-			Logger::Error("Invalid setting name: \"" + settingName + "\"");
-			return std::make_pair<std::string, std::string>("", "");
-		}
-		auto key = settingName.substr(0, colonIndex);
-		auto section = settingName.substr(colonIndex + 1);
-		return std::pair<std::string, std::string>(section, key);
+	bool ReadBool(std::string& fileName, std::string& settingName, bool def, bool cache) {
+		return ReadInt(fileName, settingName, def ? 1 : 0, cache) == 1;
 	}
 
-	void WriteString(std::string& fileName, std::string& settingName, std::string& value, bool cache) {
+	std::vector<std::string> ReadStringList(std::string& fileName, std::string& settingName, std::string& delimiter, bool cache) {
 		auto pair = ExtractSettingAndKey(settingName);
 		auto& section = pair.first;
 		auto& key = pair.second;
 		if (section.compare("") == 0 || key.compare("") == 0) {
-			Logger::Msg("No value was written for setting name: \"" + settingName + "\"");
-			return;
-		}
-
-		Logger::DebugMsg("Write File: " + IniAccess(fileName, section, key) + " value=" + value);
-		// write to cache, creating one if it does not exist
-		if (cache) {
-			IniHandler::GetInstance().GetIniCache(fileName).Write(section, key, value);
+			Logger::Msg("No value was read for setting name: \"" + settingName + "\"");
+			return std::vector<std::string>();
 		}
-		else {
-			// write to cache if it exists, but do not create a new one
-			if (IniHandler::GetInstance().HasIniCache(fileName)) {
-				IniHandler::GetInstance().GetIniCache(fileName).Write(section, key, value);
-			}
-			// write without cache
-			FileHelper::CreateParentDir(fileName);
-			if (!WritePrivateProfileStringA(section.c_str(), key.c_str(), value.c_str(), fileName.c_str())) {
-				Logger::Msg("Failed to write file: " + fileName);
-				Logger::Msg("	 Check that the path is correct and the file is not protected or read-only.");
-			}
+		// read from cache, creating one if it does not exist
+		// or read from cache if it exists, but do not create a new one
+		if (cache || IniHandler::GetInstance().HasIniCache(fileName)) {
+			return IniHandler::GetInstance().GetIniCache(fileName)->ReadStringList(section, key, delimiter);
 		}
+		// read without cache
+		return SplitList(ReadString(fileName, settingName, std::string(""), false, FULL_VALUE), delimiter);
 	}
 
-	void WriteInt(std::string& fileName, std::string& settingName, SInt32 value, bool cache) { WriteString(fileName, settingName, std::to_string(value), cache); }
-	void WriteBool(std::string& fileName, std::string& settingName, bool value, bool cache) { WriteString(fileName, settingName, std::string(value ? "1" : "0"), cache); }
-	void WriteFloat(std::string& fileName, std::string& settingName, float value, bool cache) { WriteString(fileName, settingName, std::to_string(value), cache); }
+	std::vector<SInt32> ReadIntList(std::string& fileName, std::string& settingName, std::string& delimiter, bool cache) {
+		auto pair = ExtractSettingAndKey(settingName);
+		if (pair.first.compare("") != 0 && pair.second.compare("") != 0 && (cache || IniHandler::GetInstance().HasIniCache(fileName))) {
+			return IniHandler::GetInstance().GetIniCache(fileName)->ReadIntList(pair.first, pair.second, delimiter);
+		}
+		return ToIntList(ReadStringList(fileName, settingName, delimiter, cache));
+	}
 
-	void CloseReader(std::string& fileName) {
-		IniHandler::GetInstance().CloseIniCache(fileName);
+	std::vector<float> ReadFloatList(std::string& fileName, std::string& settingName, std::string& delimiter, bool cache) {
+		auto pair = ExtractSettingAndKey(settingName);
+		if (pair.first.compare("") != 0 && pair.second.compare("") != 0 && (cache || IniHandler::GetInstance().HasIniCache(fileName))) {
+			return IniHandler::GetInstance().GetIniCache(fileName)->ReadFloatList(pair.first, pair.second, delimiter);
+		}
+		return ToFloatList(ReadStringList(fileName, settingName, delimiter, cache));
 	}
 
-	std::string ReadString(std::string& fileName, std::string& settingName, std::string& def, bool cache, SInt32 bufferSize) {
+	// serializes non-buffered read-modify-write operations, since they cannot use the lock of an IniCache
+	std::mutex g_updateLock;
+
+	/// <summary>
+	/// Reads a setting, computes its new value and writes it as a single atomic operation. Returns the value after the update.
+	/// See IniCache::Update for the parameters of update.
+	/// Non-buffered updates are only atomic with respect to other updates, not to regular non-buffered writes.
+	/// </summary>
+	std::string UpdateString(std::string& fileName, std::string& settingName, std::function<bool(const char*, std::string&)> update, bool cache) {
 		auto pair = ExtractSettingAndKey(settingName);
 		auto& section = pair.first;
 		auto& key = pair.second;
-
 		if (section.compare("") == 0 || key.compare("") == 0) {
-			Logger::Msg("No value was read for setting name: \"" + settingName + "\"");
-			return def;
+			Logger::Msg("No value was updated for setting name: \"" + settingName + "\"");
+			return std::string("");
 		}
 
 		std::string value;
-		// read from cache, creating one if it does not exist
+		// update cache, creating one if it does not exist
 		if (cache) {
-			value = IniHandler::GetInstance().GetIniCache(fileName).Read(section, key, def);
+			IniHandler::GetInstance().GetIniCache(fileName)->Update(section, key, update, value);
+			return value;
 		}
-		else {
-			// read from cache if it exists, but do not create a new one
-			if (IniHandler::GetInstance().HasIniCache(fileName)) {
-				return ReadString(fileName, settingName, def, true, bufferSize);
-			}
-			// read without cache
-			char* inBuf;
-
-#if LEGENDARY_EDITION
-			inBuf = (char*)FormHeap_Allocate(sizeof(char) * (bufferSize + 1));
-#else
-			inBuf = (char*)Heap_Allocate(sizeof(char) * (bufferSize + 1));
-#endif
-
-			if (GetPrivateProfileStringA(section.c_str(), key.c_str(), def.c_str(), inBuf, bufferSize+1, fileName.c_str())) {
-				value = std::string(inBuf);
-			}
-			else {
-				FileHelper::FileCannotBeLoaded(fileName);
+		std::lock_guard<std::mutex> guard(g_updateLock);
+		// update cache if it exists, but do not create a new one
+		if (IniHandler::GetInstance().HasIniCache(fileName)) {
+			// the cache already holds the new value, so only the file is written
+			if (IniHandler::GetInstance().GetIniCache(fileName)->Update(section, key, update, value)) {
+				WriteFileSetting(fileName, section, key, value);
 			}
-			Logger::DebugMsg("Read File: " + IniAccess(fileName, section, key) + " value=" + value);
-		}
-		return value;
-	}
-
-	SInt32 ReadInt(std::string& fileName, std::string& settingName, SInt32 def, bool cache) {
-
-		SInt32 value;
-		try {
-			value = std::stoi(ReadString(fileName, settingName, std::to_string(def), cache, BUFFER_SIZE).c_str());
+			return value;
 		}
-		catch (std::invalid_argument) {
-			value = def;
+		// update without cache, an ini value cannot contain a line break, so it is used to detect missing values
+		// the whole value is read, since the new value is built from it
+		auto oldValue = ReadString(fileName, settingName, std::string("\n"), false, FULL_VALUE);
+		bool exists = oldValue.compare("\n") != 0;
+		if (update(exists ? oldValue.c_str() : nullptr, value)) {
+			WriteSetting(fileName, section, key, value, false);
+			return value;
 		}
-		return value;
+		return exists ? oldValue : std::string("");
 	}
 
-	float ReadFloat(std::string& fileName, std::string& settingName, float def, bool cache) {
-		float value = def;
-		try {
-			value = std::stof(ReadString(fileName, settingName, std::to_string(def), cache, BUFFER_SIZE).c_str());
-		}
-		catch (std::invalid_argument) {
-			value = def;
-		}
-		return value;
+	SInt32 IncrementInt(std::string& fileName, std::string& settingName, SInt32 increment, SInt32 def, bool cache) {
+		auto value = UpdateString(fileName, settingName, [increment, def](const char* oldValue, std::string& newValue) {
+			newValue = std::to_string((oldValue != nullptr ? ParseInt(oldValue, def) : def) + increment);
+			return true;
+		}, cache);
+		return ParseInt(value, def);
 	}
 
+	std::string CompareAndSetString(std::string& fileName, std::string& settingName, std::string& expected, std::string& value, bool cache) {
+		return UpdateString(fileName, settingName, [&expected, &value](const char* oldValue, std::string& newValue) {
+			if (expected.compare(oldValue != nullptr ? oldValue : "") != 0) {
+				return false;
+			}
+			newValue = value;
+			return true;
+		}, cache);
+	}
 
-
-	bool ReadBool(std::string& fileName, std::string& settingName, bool def, bool cache) {
-		return ReadInt(fileName, settingName, def ? 1 : 0, cache) == 1;
+	std::string AppendToList(std::string& fileName, std::string& settingName, std::string& element, std::string& delimiter, bool cache) {
+		return UpdateString(fileName, settingName, [&element, &delimiter](const char* oldValue, std::string& newValue) {
+			if (oldValue == nullptr || SplitList(oldValue, delimiter).empty()) {
+				newValue = element;
+			}
+			else {
+				newValue = std::string(oldValue) + (delimiter.compare("") != 0 ? delimiter : LIST_DELIMITER) + element;
+			}
+			return true;
+		}, cache);
 	}
 
 	bool HasString(std::string& fileName, std::string& settingName, bool cache) {
@@ -366,24 +4542,169 @@ namespace PapyrusIni {
 		return std::string(in.data);
 	}
 
+	BSFixedString ParseString(std::string value, BSFixedString def) {
+		return ToPapyrusString(value);
+	}
+
+	std::string FormatInt(SInt32 value) {
+		return std::to_string(value);
+	}
+
+	std::string FormatFloat(float value) {
+		return std::to_string(value);
+	}
+
+	std::string FormatBool(bool value) {
+		return std::string(value ? "1" : "0");
+	}
+
+	std::string FormatString(BSFixedString value) {
+		return ToStdString(value);
+	}
+
 	std::string FromPapyrusPath(BSFixedString path) {
-		return std::string("Data\\") + path.data;
+		return CanonicalPaths::GetInstance().Get(path.data);
+	}
+
+	std::string ToPapyrusPath(std::string path) {
+		if (path.compare(0, 5, "Data\\") == 0) {
+			return path.substr(5);
+		}
+		return path;
+	}
+
+	std::vector<std::string> FromPapyrusArray(VMArray<BSFixedString> arr) {
+		std::vector<std::string> result;
+		result.reserve(arr.Length());
+		for (UInt32 i = 0; i < arr.Length(); i++) {
+			BSFixedString str;
+			arr.Get(&str, i);
+			result.push_back(ToStdString(str));
+		}
+		return result;
+	}
+
+	VMResultArray<BSFixedString> ToPapyrusArray(std::vector<std::string>& arr) {
+		VMResultArray<BSFixedString> result;
+		result.reserve(arr.size());
+		for (auto& str : arr) {
+			result.push_back(ToPapyrusString(str));
+		}
+		return result;
+	}
+
+	VMResultArray<SInt32> ToPapyrusArray(std::vector<SInt32>& arr) {
+		VMResultArray<SInt32> result;
+		result.assign(arr.begin(), arr.end());
+		return result;
+	}
+
+	VMResultArray<float> ToPapyrusArray(std::vector<float>& arr) {
+		VMResultArray<float> result;
+		result.assign(arr.begin(), arr.end());
+		return result;
 	}
 
 	void Buffered_CreateBuffer(PAPYRUS_FUNCTION, BSFixedString file) {
 		CreateCache(FromPapyrusPath(file));
 	}
+	SInt32 Buffered_CreateBuffersForDirectory(PAPYRUS_FUNCTION, BSFixedString directory, BSFixedString pattern, BSFixedString eventName) {
+		return CreateCachesForDirectory(ToStdString(directory), ToStdString(pattern), ToStdString(eventName));
+	}
 	void Buffered_WriteBuffer(PAPYRUS_FUNCTION, BSFixedString file) {
 		WriteCache(FromPapyrusPath(file));
 	}
 	void Buffered_CloseBuffer(PAPYRUS_FUNCTION, BSFixedString file) {
 		CloseCache(FromPapyrusPath(file));
 	}
+	SInt32 Buffered_SnapshotBuffer(PAPYRUS_FUNCTION, BSFixedString file) {
+		return SnapshotCache(FromPapyrusPath(file));
+	}
+	bool Buffered_RestoreBuffer(PAPYRUS_FUNCTION, BSFixedString file, SInt32 handle) {
+		return RestoreCache(FromPapyrusPath(file), handle);
+	}
+	void Buffered_ReleaseSnapshot(PAPYRUS_FUNCTION, SInt32 handle) {
+		ReleaseSnapshot(handle);
+	}
+	void Buffered_SwitchProfile(PAPYRUS_FUNCTION, BSFixedString activeFile, BSFixedString profileFile) {
+		SwitchProfile(FromPapyrusPath(activeFile), FromPapyrusPath(profileFile));
+	}
+	void Buffered_SetMemoryBudget(PAPYRUS_FUNCTION, SInt32 kilobytes) {
+		IniHandler::GetInstance().SetMemoryBudget((size_t)(std::max)(kilobytes, 0) * 1024);
+	}
+	SInt32 Buffered_GetMemoryUsage(PAPYRUS_FUNCTION) {
+		return (SInt32)(IniHandler::GetInstance().GetResidentBytes() / 1024);
+	}
+	SInt32 Buffered_GetEvictionCount(PAPYRUS_FUNCTION) {
+		return (SInt32)IniHandler::GetInstance().GetEvictionCount();
+	}
+	void Buffered_SetFileWatcherEnabled(PAPYRUS_FUNCTION, bool enabled) {
+		FileWatcher::GetInstance().SetEnabled(enabled);
+	}
 
 	SInt32 Papyrus_GetPluginVersion(StaticFunctionTag* base) {
 		return PLUGIN_VERSION;
 	}
 
+	void Papyrus_FlushDefaults(StaticFunctionTag* base) {
+		PendingDefaults::GetInstance().FlushAll();
+	}
+
+	void Papyrus_SetReadCacheEnabled(StaticFunctionTag* base, bool enabled, SInt32 checkInterval) {
+		ReadCache::GetInstance().SetEnabled(enabled, (UInt32)(std::max)(checkInterval, 0));
+	}
+
+	void Papyrus_SetAutoBufferEnabled(StaticFunctionTag* base, bool enabled, SInt32 threshold, SInt32 idleTime) {
+		AutoBuffer::GetInstance().SetEnabled(enabled, (UInt32)(std::max)(threshold, 1), (UInt32)(std::max)(idleTime, 0));
+	}
+
+	VMResultArray<BSFixedString> Papyrus_GetAutoBufferedFiles(StaticFunctionTag* base) {
+		std::vector<std::string> files;
+		for (auto& path : AutoBuffer::GetInstance().GetPromoted()) {
+			files.push_back(ToPapyrusPath(path));
+		}
+		return ToPapyrusArray(files);
+	}
+
+	void Papyrus_SetKeyIndexEnabled(StaticFunctionTag* base, bool enabled) {
+		if (enabled == KeyIndex::GetInstance().IsEnabled()) {
+			return;
+		}
+		KeyIndex::GetInstance().SetEnabled(enabled);
+		if (enabled) {
+			IniHandler::GetInstance().IndexAll();
+		}
+	}
+
+	VMResultArray<BSFixedString> Papyrus_FindFilesDefining(StaticFunctionTag* base, BSFixedString settingName) {
+		auto pair = ExtractSettingAndKey(ToStdString(settingName));
+		std::vector<std::string> files;
+		for (auto& path : KeyIndex::GetInstance().Find(pair.first, pair.second)) {
+			files.push_back(ToPapyrusPath(path));
+		}
+		return ToPapyrusArray(files);
+	}
+
+	SInt32 Papyrus_GetFileGeneration(StaticFunctionTag* base, BSFixedString file) {
+		return (SInt32)Generations::GetInstance().GetFile(FromPapyrusPath(file));
+	}
+
+	SInt32 Papyrus_GetSectionGeneration(StaticFunctionTag* base, BSFixedString file, BSFixedString section) {
+		return (SInt32)Generations::GetInstance().GetSection(FromPapyrusPath(file), ToStdString(section));
+	}
+
+	void Papyrus_SubscribeToSetting(StaticFunctionTag* base, BSFixedString file, BSFixedString settingName, BSFixedString eventName) {
+		SubscribeToSetting(FromPapyrusPath(file), ToStdString(settingName), ToStdString(eventName));
+	}
+
+	void Papyrus_SubscribeToSection(StaticFunctionTag* base, BSFixedString file, BSFixedString section, BSFixedString eventName) {
+		SubscribeToSection(FromPapyrusPath(file), ToStdString(section), ToStdString(eventName));
+	}
+
+	void Papyrus_Unsubscribe(StaticFunctionTag* base, BSFixedString file, BSFixedString eventName) {
+		ChangeNotifier::GetInstance().Unsubscribe(FromPapyrusPath(file), ToStdString(eventName));
+	}
+
 #define DEFINE_FUNCTIONS_PREFIX(Prefix, Type, cType, cache) \
 void Prefix##_Write##Type(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString settingName, cType value) { Write##Type(FromPapyrusPath(file), ToStdString(settingName), value, cache);} \
 cType Prefix##_Read##Type(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString settingName, cType def) { return Read##Type(FromPapyrusPath(file), ToStdString(settingName) , def, cache);} \
@@ -391,7 +4712,7 @@ bool Prefix##_Has##Type(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString sett
 \
 cType Prefix##_Read##Type##Ex(PAPYRUS_FUNCTION, BSFixedString fileDefault, BSFixedString fileUser, BSFixedString settingName, cType def) { \
 	if(!Has##Type(FromPapyrusPath(fileDefault), ToStdString(settingName), cache)) {\
-		Write##Type(FromPapyrusPath(fileDefault), ToStdString(settingName), def, cache); \
+		WriteDefault##Type(FromPapyrusPath(fileDefault), ToStdString(settingName), def, cache); \
 	} \
 	return Read##Type(FromPapyrusPath(fileUser), ToStdString(settingName), Read##Type(FromPapyrusPath(fileDefault), ToStdString(settingName), def, cache), cache);\
 }
@@ -403,7 +4724,7 @@ bool Prefix##_HasString(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString sett
 \
 BSFixedString Prefix##_ReadString##Ex(PAPYRUS_FUNCTION, BSFixedString fileDefault, BSFixedString fileUser, BSFixedString settingName, BSFixedString def, SInt32 bufferSize) { \
 	if(!HasString(FromPapyrusPath(fileDefault), ToStdString(settingName), cache)) {\
-		WriteString(FromPapyrusPath(fileDefault), ToStdString(settingName), ToStdString(def), cache); \
+		WriteDefaultString(FromPapyrusPath(fileDefault), ToStdString(settingName), ToStdString(def), cache); \
 	} \
 	return ToPapyrusString( ReadString(FromPapyrusPath(fileUser), ToStdString(settingName), ReadString(FromPapyrusPath(fileDefault), ToStdString(settingName), ToStdString(def), cache, bufferSize), cache, bufferSize));\
 }
@@ -424,6 +4745,156 @@ DEFINE_FUNCTIONS_PREFIX_STRING(Buffered, true)
 		DEFINE_FUNCTIONS(Bool, bool)
 		DEFINE_FUNCTIONS_STRING()
 
+#define DEFINE_ARRAY_FUNCTIONS_PREFIX(Prefix, Type, cType, cache) \
+VMResultArray<cType> Prefix##_Read##Type##Array(PAPYRUS_FUNCTION, BSFixedString file, VMArray<BSFixedString> settingNames, VMArray<cType> defs) { \
+	std::vector<std::string> values; \
+	std::vector<bool> found; \
+	ReadStrings(FromPapyrusPath(file), FromPapyrusArray(settingNames), values, found, cache); \
+	VMResultArray<cType> result; \
+	result.reserve(values.size()); \
+	for (UInt32 i = 0; i < values.size(); i++) { \
+		cType def = cType(); \
+		if (i < defs.Length()) { \
+			defs.Get(&def, i); \
+		} \
+		result.push_back(found[i] ? Parse##Type(values[i], def) : def); \
+	} \
+	return result; \
+} \
+void Prefix##_Write##Type##Array(PAPYRUS_FUNCTION, BSFixedString file, VMArray<BSFixedString> settingNames, VMArray<cType> values) { \
+	std::vector<std::string> strValues; \
+	strValues.reserve(values.Length()); \
+	for (UInt32 i = 0; i < values.Length(); i++) { \
+		cType value; \
+		values.Get(&value, i); \
+		strValues.push_back(Format##Type(value)); \
+	} \
+	WriteStrings(FromPapyrusPath(file), FromPapyrusArray(settingNames), strValues, cache); \
+}
+
+#define DEFINE_HAS_ARRAY_PREFIX(Prefix, cache) \
+VMResultArray<bool> Prefix##_HasArray(PAPYRUS_FUNCTION, BSFixedString file, VMArray<BSFixedString> settingNames) { \
+	std::vector<std::string> values; \
+	std::vector<bool> found; \
+	ReadStrings(FromPapyrusPath(file), FromPapyrusArray(settingNames), values, found, cache); \
+	VMResultArray<bool> result; \
+	result.reserve(found.size()); \
+	for (UInt32 i = 0; i < found.size(); i++) { \
+		result.push_back(found[i]); \
+	} \
+	return result; \
+}
+
+#define DEFINE_SECTION_FUNCTIONS_PREFIX(Prefix, cache) \
+VMResultArray<BSFixedString> Prefix##_ReadSectionKeys(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString section, SInt32 start, SInt32 count) { \
+	std::vector<std::string> keys; \
+	ReadSection(FromPapyrusPath(file), ToStdString(section), start, count, &keys, nullptr, cache); \
+	return ToPapyrusArray(keys); \
+} \
+VMResultArray<BSFixedString> Prefix##_ReadSectionValues(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString section, SInt32 start, SInt32 count) { \
+	std::vector<std::string> values; \
+	ReadSection(FromPapyrusPath(file), ToStdString(section), start, count, nullptr, &values, cache); \
+	return ToPapyrusArray(values); \
+} \
+VMResultArray<BSFixedString> Prefix##_FindKeys(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString section, BSFixedString prefix) { \
+	auto keys = FindKeys(FromPapyrusPath(file), ToStdString(section), ToStdString(prefix), std::string(""), cache); \
+	return ToPapyrusArray(keys); \
+} \
+VMResultArray<BSFixedString> Prefix##_FindKeysMatching(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString section, BSFixedString pattern) { \
+	auto keys = FindKeysMatching(FromPapyrusPath(file), ToStdString(section), ToStdString(pattern), cache); \
+	return ToPapyrusArray(keys); \
+} \
+SInt32 Prefix##_GetSectionSize(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString section) { \
+	return GetSectionSize(FromPapyrusPath(file), ToStdString(section), cache); \
+} \
+void Prefix##_WriteSection(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString section, VMArray<BSFixedString> keys, VMArray<BSFixedString> values, bool replace) { \
+	WriteSection(FromPapyrusPath(file), ToStdString(section), FromPapyrusArray(keys), FromPapyrusArray(values), replace, cache); \
+}
+
+#define DEFINE_LIST_FUNCTIONS_PREFIX(Prefix, Type, cType, cache) \
+VMResultArray<cType> Prefix##_Read##Type##List(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString settingName, BSFixedString delimiter) { \
+	auto list = Read##Type##List(FromPapyrusPath(file), ToStdString(settingName), ToStdString(delimiter), cache); \
+	return ToPapyrusArray(list); \
+} \
+void Prefix##_Write##Type##List(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString settingName, VMArray<cType> values, BSFixedString delimiter) { \
+	std::vector<std::string> elements; \
+	elements.reserve(values.Length()); \
+	for (UInt32 i = 0; i < values.Length(); i++) { \
+		cType value; \
+		values.Get(&value, i); \
+		elements.push_back(Format##Type(value)); \
+	} \
+	WriteString(FromPapyrusPath(file), ToStdString(settingName), JoinList(elements, ToStdString(delimiter)), cache); \
+}
+
+#define DEFINE_LIST_FUNCTIONS(Type, cType) \
+DEFINE_LIST_FUNCTIONS_PREFIX(Papyrus, Type, cType, false) \
+DEFINE_LIST_FUNCTIONS_PREFIX(Buffered, Type, cType, true)
+
+#define DEFINE_UPDATE_FUNCTIONS_PREFIX(Prefix, cache) \
+SInt32 Prefix##_IncrementInt(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString settingName, SInt32 increment, SInt32 def) { \
+	return IncrementInt(FromPapyrusPath(file), ToStdString(settingName), increment, def, cache); \
+} \
+BSFixedString Prefix##_CompareAndSetString(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString settingName, BSFixedString expected, BSFixedString value) { \
+	return ToPapyrusString(CompareAndSetString(FromPapyrusPath(file), ToStdString(settingName), ToStdString(expected), ToStdString(value), cache)); \
+} \
+BSFixedString Prefix##_AppendToList(PAPYRUS_FUNCTION, BSFixedString file, BSFixedString settingName, BSFixedString element, BSFixedString delimiter) { \
+	return ToPapyrusString(AppendToList(FromPapyrusPath(file), ToStdString(settingName), ToStdString(element), ToStdString(delimiter), cache)); \
+}
+
+#define DEFINE_TRANSACTION_FUNCTIONS_PREFIX(Prefix, cache) \
+SInt32 Prefix##_BeginTransaction(PAPYRUS_FUNCTION, BSFixedString file) { \
+	return BeginTransaction(FromPapyrusPath(file), cache); \
+}
+
+// the handle knows whether the transaction is buffered, so both classes share these functions
+#define DEFINE_TRANSACTION_WRITE(Type, cType) \
+void Papyrus_TransactionWrite##Type(PAPYRUS_FUNCTION, SInt32 transaction, BSFixedString settingName, cType value) { \
+	TransactionWriteString(transaction, ToStdString(settingName), Format##Type(value)); \
+}
+
+#define DEFINE_MERGE_FUNCTIONS_PREFIX(Prefix, cache) \
+void Prefix##_MergeIni(PAPYRUS_FUNCTION, BSFixedString srcFile, BSFixedString dstFile, bool overwrite) { \
+	MergeIni(FromPapyrusPath(srcFile), FromPapyrusPath(dstFile), overwrite, cache); \
+} \
+void Prefix##_CopySection(PAPYRUS_FUNCTION, BSFixedString srcFile, BSFixedString dstFile, BSFixedString section) { \
+	CopySection(FromPapyrusPath(srcFile), FromPapyrusPath(dstFile), ToStdString(section), cache); \
+}
+
+#define DEFINE_ARRAY_FUNCTIONS(Type, cType) \
+DEFINE_ARRAY_FUNCTIONS_PREFIX(Papyrus, Type, cType, false) \
+DEFINE_ARRAY_FUNCTIONS_PREFIX(Buffered, Type, cType, true)
+
+	DEFINE_ARRAY_FUNCTIONS(Int, SInt32)
+		DEFINE_ARRAY_FUNCTIONS(Float, float)
+		DEFINE_ARRAY_FUNCTIONS(Bool, bool)
+		DEFINE_ARRAY_FUNCTIONS(String, BSFixedString)
+		DEFINE_HAS_ARRAY_PREFIX(Papyrus, false)
+		DEFINE_HAS_ARRAY_PREFIX(Buffered, true)
+		DEFINE_SECTION_FUNCTIONS_PREFIX(Papyrus, false)
+		DEFINE_SECTION_FUNCTIONS_PREFIX(Buffered, true)
+		DEFINE_UPDATE_FUNCTIONS_PREFIX(Papyrus, false)
+		DEFINE_UPDATE_FUNCTIONS_PREFIX(Buffered, true)
+		DEFINE_TRANSACTION_FUNCTIONS_PREFIX(Papyrus, false)
+		DEFINE_TRANSACTION_FUNCTIONS_PREFIX(Buffered, true)
+		DEFINE_TRANSACTION_WRITE(Int, SInt32)
+		DEFINE_TRANSACTION_WRITE(Float, float)
+		DEFINE_TRANSACTION_WRITE(Bool, bool)
+		DEFINE_TRANSACTION_WRITE(String, BSFixedString)
+
+	void Papyrus_CommitTransaction(StaticFunctionTag* base, SInt32 transaction) {
+		CommitTransaction(transaction);
+	}
+
+	void Papyrus_RollbackTransaction(StaticFunctionTag* base, SInt32 transaction) {
+		RollbackTransaction(transaction);
+	}
+		DEFINE_MERGE_FUNCTIONS_PREFIX(Papyrus, false)
+		DEFINE_MERGE_FUNCTIONS_PREFIX(Buffered, true)
+		DEFINE_LIST_FUNCTIONS(Int, SInt32)
+		DEFINE_LIST_FUNCTIONS(Float, float)
+		DEFINE_LIST_FUNCTIONS(String, BSFixedString)
+
 
 
 #define REGISTER_WRITE(Prefix, Type, cType) registry->RegisterFunction( \
@@ -477,17 +4948,153 @@ new NativeFunction4 <StaticFunctionTag, cType, BSFixedString, BSFixedString, cTy
 	registry->SetFunctionFlags("BufferedIni", "Read" #Type, VMClassRegistry::kFunctionFlag_NoWait)
 
 
+#define REGISTER_READ_ARRAY(Type, cType) registry->RegisterFunction( \
+new NativeFunction3 <StaticFunctionTag, VMResultArray<cType>, BSFixedString, VMArray<BSFixedString>, VMArray<cType>>("Read" #Type "Array", "PapyrusIni", Papyrus##_Read##Type##Array, registry)); \
+	registry->SetFunctionFlags("PapyrusIni", "Read" #Type "Array", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction3 <StaticFunctionTag, VMResultArray<cType>, BSFixedString, VMArray<BSFixedString>, VMArray<cType>>("Read" #Type "Array", "BufferedIni", Buffered##_Read##Type##Array, registry)); \
+	registry->SetFunctionFlags("BufferedIni", "Read" #Type "Array", VMClassRegistry::kFunctionFlag_NoWait)
+
+#define REGISTER_WRITE_ARRAY(Type, cType) registry->RegisterFunction( \
+new NativeFunction3 <StaticFunctionTag, void, BSFixedString, VMArray<BSFixedString>, VMArray<cType>>("Write" #Type "Array", "PapyrusIni", Papyrus##_Write##Type##Array, registry)); \
+	registry->SetFunctionFlags("PapyrusIni", "Write" #Type "Array", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction3 <StaticFunctionTag, void, BSFixedString, VMArray<BSFixedString>, VMArray<cType>>("Write" #Type "Array", "BufferedIni", Buffered##_Write##Type##Array, registry)); \
+	registry->SetFunctionFlags("BufferedIni", "Write" #Type "Array", VMClassRegistry::kFunctionFlag_NoWait)
+
+#define REGISTER_LIST(Type, cType) registry->RegisterFunction( \
+new NativeFunction3 <StaticFunctionTag, VMResultArray<cType>, BSFixedString, BSFixedString, BSFixedString>("Read" #Type "List", "PapyrusIni", Papyrus##_Read##Type##List, registry)); \
+	registry->SetFunctionFlags("PapyrusIni", "Read" #Type "List", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction3 <StaticFunctionTag, VMResultArray<cType>, BSFixedString, BSFixedString, BSFixedString>("Read" #Type "List", "BufferedIni", Buffered##_Read##Type##List, registry)); \
+	registry->SetFunctionFlags("BufferedIni", "Read" #Type "List", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction4 <StaticFunctionTag, void, BSFixedString, BSFixedString, VMArray<cType>, BSFixedString>("Write" #Type "List", "PapyrusIni", Papyrus##_Write##Type##List, registry)); \
+	registry->SetFunctionFlags("PapyrusIni", "Write" #Type "List", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction4 <StaticFunctionTag, void, BSFixedString, BSFixedString, VMArray<cType>, BSFixedString>("Write" #Type "List", "BufferedIni", Buffered##_Write##Type##List, registry)); \
+	registry->SetFunctionFlags("BufferedIni", "Write" #Type "List", VMClassRegistry::kFunctionFlag_NoWait)
+
+#define REGISTER_UPDATE(Prefix, Class) registry->RegisterFunction( \
+new NativeFunction4 <StaticFunctionTag, SInt32, BSFixedString, BSFixedString, SInt32, SInt32>("IncrementInt", Class, Prefix##_IncrementInt, registry)); \
+	registry->SetFunctionFlags(Class, "IncrementInt", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction4 <StaticFunctionTag, BSFixedString, BSFixedString, BSFixedString, BSFixedString, BSFixedString>("CompareAndSetString", Class, Prefix##_CompareAndSetString, registry)); \
+	registry->SetFunctionFlags(Class, "CompareAndSetString", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction4 <StaticFunctionTag, BSFixedString, BSFixedString, BSFixedString, BSFixedString, BSFixedString>("AppendToList", Class, Prefix##_AppendToList, registry)); \
+	registry->SetFunctionFlags(Class, "AppendToList", VMClassRegistry::kFunctionFlag_NoWait)
+
+#define REGISTER_TRANSACTION_WRITE(Type, cType, Class) registry->RegisterFunction( \
+new NativeFunction3 <StaticFunctionTag, void, SInt32, BSFixedString, cType>("TransactionWrite" #Type, Class, Papyrus_TransactionWrite##Type, registry)); \
+	registry->SetFunctionFlags(Class, "TransactionWrite" #Type, VMClassRegistry::kFunctionFlag_NoWait)
+
+#define REGISTER_TRANSACTION(Prefix, Class) registry->RegisterFunction( \
+new NativeFunction1 <StaticFunctionTag, SInt32, BSFixedString>("BeginTransaction", Class, Prefix##_BeginTransaction, registry)); \
+	registry->SetFunctionFlags(Class, "BeginTransaction", VMClassRegistry::kFunctionFlag_NoWait); \
+REGISTER_TRANSACTION_WRITE(Int, SInt32, Class); \
+REGISTER_TRANSACTION_WRITE(Float, float, Class); \
+REGISTER_TRANSACTION_WRITE(Bool, bool, Class); \
+REGISTER_TRANSACTION_WRITE(String, BSFixedString, Class); \
+registry->RegisterFunction( \
+new NativeFunction1 <StaticFunctionTag, void, SInt32>("CommitTransaction", Class, Papyrus_CommitTransaction, registry)); \
+	registry->SetFunctionFlags(Class, "CommitTransaction", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction1 <StaticFunctionTag, void, SInt32>("RollbackTransaction", Class, Papyrus_RollbackTransaction, registry)); \
+	registry->SetFunctionFlags(Class, "RollbackTransaction", VMClassRegistry::kFunctionFlag_NoWait)
+
+#define REGISTER_MERGE(Prefix, Class) registry->RegisterFunction( \
+new NativeFunction3 <StaticFunctionTag, void, BSFixedString, BSFixedString, bool>("MergeIni", Class, Prefix##_MergeIni, registry)); \
+	registry->SetFunctionFlags(Class, "MergeIni", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction3 <StaticFunctionTag, void, BSFixedString, BSFixedString, BSFixedString>("CopySection", Class, Prefix##_CopySection, registry)); \
+	registry->SetFunctionFlags(Class, "CopySection", VMClassRegistry::kFunctionFlag_NoWait)
+
+#define REGISTER_HAS_ARRAY() registry->RegisterFunction( \
+new NativeFunction2 <StaticFunctionTag, VMResultArray<bool>, BSFixedString, VMArray<BSFixedString>>("HasArray", "PapyrusIni", Papyrus_HasArray, registry)); \
+	registry->SetFunctionFlags("PapyrusIni", "HasArray", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction2 <StaticFunctionTag, VMResultArray<bool>, BSFixedString, VMArray<BSFixedString>>("HasArray", "BufferedIni", Buffered_HasArray, registry)); \
+	registry->SetFunctionFlags("BufferedIni", "HasArray", VMClassRegistry::kFunctionFlag_NoWait)
+
+#define REGISTER_SECTION(Prefix, Class) registry->RegisterFunction( \
+new NativeFunction4 <StaticFunctionTag, VMResultArray<BSFixedString>, BSFixedString, BSFixedString, SInt32, SInt32>("ReadSectionKeys", Class, Prefix##_ReadSectionKeys, registry)); \
+	registry->SetFunctionFlags(Class, "ReadSectionKeys", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction4 <StaticFunctionTag, VMResultArray<BSFixedString>, BSFixedString, BSFixedString, SInt32, SInt32>("ReadSectionValues", Class, Prefix##_ReadSectionValues, registry)); \
+	registry->SetFunctionFlags(Class, "ReadSectionValues", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction2 <StaticFunctionTag, SInt32, BSFixedString, BSFixedString>("GetSectionSize", Class, Prefix##_GetSectionSize, registry)); \
+	registry->SetFunctionFlags(Class, "GetSectionSize", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction3 <StaticFunctionTag, VMResultArray<BSFixedString>, BSFixedString, BSFixedString, BSFixedString>("FindKeys", Class, Prefix##_FindKeys, registry)); \
+	registry->SetFunctionFlags(Class, "FindKeys", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction3 <StaticFunctionTag, VMResultArray<BSFixedString>, BSFixedString, BSFixedString, BSFixedString>("FindKeysMatching", Class, Prefix##_FindKeysMatching, registry)); \
+	registry->SetFunctionFlags(Class, "FindKeysMatching", VMClassRegistry::kFunctionFlag_NoWait); \
+registry->RegisterFunction( \
+new NativeFunction5 <StaticFunctionTag, void, BSFixedString, BSFixedString, VMArray<BSFixedString>, VMArray<BSFixedString>, bool>("WriteSection", Class, Prefix##_WriteSection, registry)); \
+	registry->SetFunctionFlags(Class, "WriteSection", VMClassRegistry::kFunctionFlag_NoWait)
+
 		bool RegisterFuncs(VMClassRegistry* registry) {
 
 		registry->RegisterFunction(
 			new NativeFunction0 <StaticFunctionTag, SInt32>("GetPluginVersion", "PapyrusIni", Papyrus_GetPluginVersion, registry));
 		registry->SetFunctionFlags("PapyrusIni", "GetPluginVersion", VMClassRegistry::kFunctionFlag_NoWait);
 
+		registry->RegisterFunction(
+			new NativeFunction0 <StaticFunctionTag, void>("FlushDefaults", "PapyrusIni", Papyrus_FlushDefaults, registry));
+		registry->SetFunctionFlags("PapyrusIni", "FlushDefaults", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction2 <StaticFunctionTag, void, bool, SInt32>("SetReadCacheEnabled", "PapyrusIni", Papyrus_SetReadCacheEnabled, registry));
+		registry->SetFunctionFlags("PapyrusIni", "SetReadCacheEnabled", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction3 <StaticFunctionTag, void, bool, SInt32, SInt32>("SetAutoBufferEnabled", "PapyrusIni", Papyrus_SetAutoBufferEnabled, registry));
+		registry->SetFunctionFlags("PapyrusIni", "SetAutoBufferEnabled", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction0 <StaticFunctionTag, VMResultArray<BSFixedString>>("GetAutoBufferedFiles", "PapyrusIni", Papyrus_GetAutoBufferedFiles, registry));
+		registry->SetFunctionFlags("PapyrusIni", "GetAutoBufferedFiles", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction1 <StaticFunctionTag, void, bool>("SetKeyIndexEnabled", "PapyrusIni", Papyrus_SetKeyIndexEnabled, registry));
+		registry->SetFunctionFlags("PapyrusIni", "SetKeyIndexEnabled", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction1 <StaticFunctionTag, VMResultArray<BSFixedString>, BSFixedString>("FindFilesDefining", "PapyrusIni", Papyrus_FindFilesDefining, registry));
+		registry->SetFunctionFlags("PapyrusIni", "FindFilesDefining", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction1 <StaticFunctionTag, SInt32, BSFixedString>("GetFileGeneration", "PapyrusIni", Papyrus_GetFileGeneration, registry));
+		registry->SetFunctionFlags("PapyrusIni", "GetFileGeneration", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction2 <StaticFunctionTag, SInt32, BSFixedString, BSFixedString>("GetSectionGeneration", "PapyrusIni", Papyrus_GetSectionGeneration, registry));
+		registry->SetFunctionFlags("PapyrusIni", "GetSectionGeneration", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction3 <StaticFunctionTag, void, BSFixedString, BSFixedString, BSFixedString>("SubscribeToSetting", "PapyrusIni", Papyrus_SubscribeToSetting, registry));
+		registry->SetFunctionFlags("PapyrusIni", "SubscribeToSetting", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction3 <StaticFunctionTag, void, BSFixedString, BSFixedString, BSFixedString>("SubscribeToSection", "PapyrusIni", Papyrus_SubscribeToSection, registry));
+		registry->SetFunctionFlags("PapyrusIni", "SubscribeToSection", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction2 <StaticFunctionTag, void, BSFixedString, BSFixedString>("Unsubscribe", "PapyrusIni", Papyrus_Unsubscribe, registry));
+		registry->SetFunctionFlags("PapyrusIni", "Unsubscribe", VMClassRegistry::kFunctionFlag_NoWait);
+
 
 		registry->RegisterFunction(
 			new NativeFunction1 <StaticFunctionTag, void, BSFixedString>("CreateBuffer", "BufferedIni", Buffered_CreateBuffer, registry));
 		registry->SetFunctionFlags("BufferedIni", "CreateBuffer", VMClassRegistry::kFunctionFlag_NoWait);
 
+		registry->RegisterFunction(
+			new NativeFunction3 <StaticFunctionTag, SInt32, BSFixedString, BSFixedString, BSFixedString>("CreateBuffersForDirectory", "BufferedIni", Buffered_CreateBuffersForDirectory, registry));
+		registry->SetFunctionFlags("BufferedIni", "CreateBuffersForDirectory", VMClassRegistry::kFunctionFlag_NoWait);
+
 		registry->RegisterFunction(
 			new NativeFunction1 <StaticFunctionTag, void, BSFixedString>("WriteBuffer", "BufferedIni", Buffered_WriteBuffer, registry));
 		registry->SetFunctionFlags("BufferedIni", "WriteBuffer", VMClassRegistry::kFunctionFlag_NoWait);
@@ -496,12 +5103,71 @@ new NativeFunction4 <StaticFunctionTag, cType, BSFixedString, BSFixedString, cTy
 			new NativeFunction1 <StaticFunctionTag, void, BSFixedString>("CloseBuffer", "BufferedIni", Buffered_CloseBuffer, registry));
 		registry->SetFunctionFlags("BufferedIni", "CloseBuffer", VMClassRegistry::kFunctionFlag_NoWait);
 
+		registry->RegisterFunction(
+			new NativeFunction1 <StaticFunctionTag, SInt32, BSFixedString>("SnapshotBuffer", "BufferedIni", Buffered_SnapshotBuffer, registry));
+		registry->SetFunctionFlags("BufferedIni", "SnapshotBuffer", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction2 <StaticFunctionTag, bool, BSFixedString, SInt32>("RestoreBuffer", "BufferedIni", Buffered_RestoreBuffer, registry));
+		registry->SetFunctionFlags("BufferedIni", "RestoreBuffer", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction1 <StaticFunctionTag, void, SInt32>("ReleaseSnapshot", "BufferedIni", Buffered_ReleaseSnapshot, registry));
+		registry->SetFunctionFlags("BufferedIni", "ReleaseSnapshot", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction2 <StaticFunctionTag, void, BSFixedString, BSFixedString>("SwitchProfile", "BufferedIni", Buffered_SwitchProfile, registry));
+		registry->SetFunctionFlags("BufferedIni", "SwitchProfile", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction1 <StaticFunctionTag, void, SInt32>("SetMemoryBudget", "BufferedIni", Buffered_SetMemoryBudget, registry));
+		registry->SetFunctionFlags("BufferedIni", "SetMemoryBudget", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction0 <StaticFunctionTag, SInt32>("GetMemoryUsage", "BufferedIni", Buffered_GetMemoryUsage, registry));
+		registry->SetFunctionFlags("BufferedIni", "GetMemoryUsage", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction0 <StaticFunctionTag, SInt32>("GetEvictionCount", "BufferedIni", Buffered_GetEvictionCount, registry));
+		registry->SetFunctionFlags("BufferedIni", "GetEvictionCount", VMClassRegistry::kFunctionFlag_NoWait);
+
+		registry->RegisterFunction(
+			new NativeFunction1 <StaticFunctionTag, void, bool>("SetFileWatcherEnabled", "BufferedIni", Buffered_SetFileWatcherEnabled, registry));
+		registry->SetFunctionFlags("BufferedIni", "SetFileWatcherEnabled", VMClassRegistry::kFunctionFlag_NoWait);
+
 		REGISTER_ALL(Papyrus, Int, SInt32);
 		REGISTER_ALL(Papyrus, Float, float);
 		REGISTER_ALL(Papyrus, Bool, bool);
 
 		REGISTER_ALL_STRING(Papyrus, String, BSFixedString);
 
+		REGISTER_READ_ARRAY(Int, SInt32);
+		REGISTER_READ_ARRAY(Float, float);
+		REGISTER_READ_ARRAY(Bool, bool);
+		REGISTER_READ_ARRAY(String, BSFixedString);
+		REGISTER_HAS_ARRAY();
+
+		REGISTER_WRITE_ARRAY(Int, SInt32);
+		REGISTER_WRITE_ARRAY(Float, float);
+		REGISTER_WRITE_ARRAY(Bool, bool);
+		REGISTER_WRITE_ARRAY(String, BSFixedString);
+
+		REGISTER_SECTION(Papyrus, "PapyrusIni");
+		REGISTER_SECTION(Buffered, "BufferedIni");
+
+		REGISTER_UPDATE(Papyrus, "PapyrusIni");
+		REGISTER_UPDATE(Buffered, "BufferedIni");
+
+		REGISTER_TRANSACTION(Papyrus, "PapyrusIni");
+		REGISTER_TRANSACTION(Buffered, "BufferedIni");
+
+		REGISTER_MERGE(Papyrus, "PapyrusIni");
+		REGISTER_MERGE(Buffered, "BufferedIni");
+
+		REGISTER_LIST(Int, SInt32);
+		REGISTER_LIST(Float, float);
+		REGISTER_LIST(String, BSFixedString);
+
 		return true;
 	}
 }
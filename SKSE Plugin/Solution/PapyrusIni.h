@@ -12,4 +12,7 @@
 namespace PapyrusIni
 {
 	bool RegisterFuncs(VMClassRegistry* registry);
+	void SetTaskInterface(SKSETaskInterface* taskInterface);
+	void SetMessagingInterface(SKSEMessagingInterface* messagingInterface);
+	void StartPrefetch();
 }
@@ -41,6 +41,8 @@ extern "C" {
 		_MESSAGE(MOD_NAME " loaded");
 
 		g_papyrus = (SKSEPapyrusInterface*)skse->QueryInterface(kInterface_Papyrus);
+		PapyrusIni::SetTaskInterface((SKSETaskInterface*)skse->QueryInterface(kInterface_Task));
+		PapyrusIni::SetMessagingInterface((SKSEMessagingInterface*)skse->QueryInterface(kInterface_Messaging));
 
 		//Check if the function registration was a success...
 		bool btest = g_papyrus->Register(PapyrusIni::RegisterFuncs);
@@ -49,6 +51,8 @@ extern "C" {
 			_MESSAGE("Papyrus functions registered");
 		}
 
+		PapyrusIni::StartPrefetch();
+
 		return true;
 	}
 };
@@ -102,6 +106,8 @@ extern "C" {
 		_MESSAGE(MOD_NAME " loaded");
 
 		g_papyrus = (SKSEPapyrusInterface*)skse->QueryInterface(kInterface_Papyrus);
+		PapyrusIni::SetTaskInterface((SKSETaskInterface*)skse->QueryInterface(kInterface_Task));
+		PapyrusIni::SetMessagingInterface((SKSEMessagingInterface*)skse->QueryInterface(kInterface_Messaging));
 
 		//Check if the function registration was a success...
 		bool btest = g_papyrus->Register(PapyrusIni::RegisterFuncs);
@@ -110,6 +116,8 @@ extern "C" {
 			_MESSAGE("Papyrus functions registered");
 		}
 
+		PapyrusIni::StartPrefetch();
+
 		return true;
 	}
 